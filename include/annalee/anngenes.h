@@ -45,6 +45,8 @@
 #include <nhp/genetics.h>
 #include <nhp/genes.h>
 #include <magic/mpackarray.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Externals
 class PatternSet;
@@ -120,6 +122,21 @@ class ANNEncoding : public Gentainer { // Abstract
 	virtual void		addPrivateGenes		(Gentainer& g, const StringMap& params) {MUST_OVERLOAD}
 	/** Implementation for @ref Object. */
 	virtual void		check				() const;
+
+	// Serialization for checkpoints
+
+	/** Size of the packed form of the encoding in bytes, or -1 if
+	 *  the encoding can not be packed. The default can't.
+	 **/
+	virtual long		packedSize			() const {return -1;}
+
+	/** Packs the encoding to a buffer of @ref packedSize bytes,
+	 *  aligned to 8 bytes.
+	 **/
+	virtual void		pack				(void* buffer) const {MUST_OVERLOAD}
+
+	/** Replaces the encoding with a packed one. */
+	virtual void		unpack				(const void* buffer, long size) {MUST_OVERLOAD}
 	
   protected:
 						ANNEncoding	() {FORBIDDEN}
@@ -141,12 +158,40 @@ class ANNEncoding : public Gentainer { // Abstract
 /*******************************************************************************
 * A genetic message for instructing the individual to save a
 * snapshot of its "brain" to a log file.
+*
+* The pictures are normally stored as String features of the
+* host. If a path is given, encodings that can stream their largest
+* pictures write them directly to files named by the path instead,
+* such as path+"-pic1.eps", and leave the feature unset.
 *******************************************************************************/
 class TakeBrainPicsMsg : public GeneticMsg {
   public:
-	TakeBrainPicsMsg (const GeneticID& rcvr, Individual& ind) : GeneticMsg (rcvr, ind) {}
+	TakeBrainPicsMsg (const GeneticID& rcvr, Individual& ind, const String& path="")
+			: GeneticMsg (rcvr, ind), mPath (path) {}
+
+	String	mPath;
 };
 
+/** Streams a picture to the file path+suffix with the given drawing
+ *  function of an object.
+ **/
+template <class T>
+void streamBrainPic (const T& obj, const String& path, const char* suffix)
+{
+	String filename = path + suffix;
+	int fd = open (filename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (fd < 0)
+		throw generic_exception (format ("Could not open '%s' for writing", (CONSTR) filename));
+	try {
+		obj.drawEPS (fd);
+	} catch (...) {
+		close (fd);
+		throw;
+	}
+	if (close (fd) != 0)
+		throw generic_exception (format ("Could not write '%s'", (CONSTR) filename));
+}
+
 #endif
 
 
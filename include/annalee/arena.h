@@ -0,0 +1,150 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ANNALEE_ARENA_H__
+#define __ANNALEE_ARENA_H__
+
+#include <stddef.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//                         _                                                //
+//                        / \       ___   _     ___                         //
+//                       /   \ |/\ /   ) |/ \   ___|                        //
+//                       |---| |   |---  |   | (   |                        //
+//                       |   | |    \__  |   |  \__|                        //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Monotonic allocator for the temporary objects of decoding.
+ *
+ * Decoding a genome allocates many small short-lived objects, such
+ * as the cells of the growth encodings, the axon tips and the
+ * intermediate matrices of the rewriting. An arena hands them out
+ * from large chunks by advancing a pointer. Nothing is freed
+ * individually; the memory is recycled all at once, either to a mark
+ * at the end of an @ref ArenaFrame or with @ref reset after each
+ * individual. Both take constant time and the chunks stay allocated
+ * for the next individual.
+ *
+ * Each thread has its own arena, so parallel evaluators do not
+ * contend for the global allocator.
+ ******************************************************************************/
+class Arena {
+  public:
+
+	/** @param chunkSize Size of the memory chunks in bytes. */
+						Arena				(long chunkSize=65536);
+						~Arena				();
+
+	/** Allocates memory aligned to the given power of two. */
+	void*				allocate			(long size, long align=8);
+
+	/** Allocates an array of objects that need no construction or
+	 *  destruction.
+	 **/
+	template<class T>
+	T*					allocate			(long n) {return static_cast<T*> (allocate (n*long(sizeof(T)), sizeof(T)<8? long(sizeof(T)) : 8));}
+
+	/** A position in the arena, for releasing the memory allocated
+	 *  after it.
+	 **/
+	struct Mark {
+		void*	chunk;
+		long	offset;
+		long	usedBefore;
+	};
+
+	Mark				mark				() const;
+	void				release				(const Mark& mark);
+
+	/** Releases all the memory. */
+	void				reset				();
+
+	/** Bytes allocated since the latest reset. */
+	long				used				() const {return mUsedBefore + mOffset;}
+
+	/** Is there an open @ref ArenaFrame to release the allocations? */
+	bool				inFrame				() const {return mFrames > 0;}
+
+	/** Maximum of @ref used over the lifetime of the arena. */
+	long				highWater			() const {return mHighWater;}
+
+	/** Returns the arena of the calling thread. */
+	static Arena&		current				();
+
+	/** Maximum high-water mark of all the arenas. */
+	static long			peak				() {return smPeak;}
+
+	/** Allocates an object of a class with arena allocation. Inside
+	 *  an @ref ArenaFrame the object is allocated from the arena of
+	 *  the thread, otherwise from the heap. Deleting an object in the
+	 *  arena does nothing; the memory is recycled with the frame.
+	 **/
+	static void*		newObject			(size_t size);
+	static void			deleteObject		(void* object);
+
+  private:
+	struct Chunk {
+		Chunk*	next;
+		long	size;
+	};
+
+	static char*		data				(Chunk* chunk) {return reinterpret_cast<char*> (chunk+1);}
+	void				nextChunk			(long size);
+
+	Chunk*				mpFirst;
+	Chunk*				mpCurrent;
+	long				mOffset;			// Allocated bytes in the current chunk
+	long				mUsedBefore;		// Allocated bytes in the previous chunks
+	long				mHighWater;
+	long				mChunkSize;
+	int					mFrames;			// Number of open frames
+
+	static long			smPeak;
+
+						Arena				(const Arena& other) {FORBIDDEN}
+	friend class ArenaFrame;
+};
+
+/*******************************************************************************
+ * Releases the memory allocated from the arena of the thread during
+ * the lifetime of the frame. The frames can be nested.
+ ******************************************************************************/
+class ArenaFrame {
+  public:
+						ArenaFrame			();
+						~ArenaFrame			();
+
+	/** The arena of the thread. */
+	Arena&				arena				() {return mrArena;}
+
+  private:
+	Arena&				mrArena;
+	Arena::Mark			mMark;
+
+						ArenaFrame			(const ArenaFrame& other) : mrArena (other.mrArena) {FORBIDDEN}
+};
+
+#endif
@@ -0,0 +1,132 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_ASYNCWRITER_H__
+#define __ANNALEE_ASYNCWRITER_H__
+
+#include <pthread.h>
+#include <magic/mstring.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//           _                           |   |     o                        //
+//          / \               _          |   |        |    ___              //
+//         /   \  ___  |   | |/ \   ___  | | | |/\ |  -+- /   ) |/\         //
+//         |---| (     |   | |   | /     |\ /| |   |  |   |---  |           //
+//         |   |  ---)  \__| |   | \___  |   | |   |   \   \__  |           //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * A unit of output work for an @ref AsyncWriter.
+ *
+ * A job owns all the data it writes, so the submitter can continue
+ * modifying its own objects as soon as the job has been submitted.
+ ******************************************************************************/
+class AsyncJob {
+  public:
+	virtual				~AsyncJob			() {}
+
+	/** Does the output. Called in the writer thread. Errors are
+	 *  reported by throwing a generic_exception.
+	 **/
+	virtual void		run					() = 0;
+};
+
+/*******************************************************************************
+ * Job that writes a string to a file, replacing the old contents.
+ ******************************************************************************/
+class FileWriteJob : public AsyncJob {
+  public:
+						FileWriteJob		(const String& filename, const String& data)
+								: mFilename (filename), mData (data) {}
+
+	virtual void		run					();
+
+  private:
+	String				mFilename;
+	String				mData;
+};
+
+/*******************************************************************************
+ * Background writer thread with a bounded queue of output jobs.
+ *
+ * The jobs are run in the order they were submitted. If the queue is
+ * full, @ref submit blocks until the writer has caught up, so a slow
+ * disk can not make the queue grow without bound.
+ *
+ * An exception from a job does not stop the writer; the first error
+ * message is kept and thrown from the next @ref flush or @ref
+ * checkErrors. The destructor
+ * flushes the queue before stopping the thread.
+ *
+ * With a zero capacity the jobs are run immediately in the calling
+ * thread.
+ ******************************************************************************/
+class AsyncWriter {
+  public:
+						AsyncWriter			(int capacity=16);
+						~AsyncWriter		();
+
+	/** Queues a job. The writer takes the ownership of the job. */
+	void				submit				(AsyncJob* job);
+
+	/** Convenience for queueing a @ref FileWriteJob. */
+	void				write				(const String& filename, const String& data) {
+		submit (new FileWriteJob (filename, data));
+	}
+
+	/** Waits until all the submitted jobs have been run.
+	 *
+	 *  @throws generic_exception if any of the jobs failed.
+	 **/
+	void				flush				();
+
+	/** Throws the first error of the jobs that have been run so far,
+	 *  without waiting for the pending ones.
+	 *
+	 *  @throws generic_exception if any of the jobs failed.
+	 **/
+	void				checkErrors			();
+
+  private:
+	static void*		writerThread		(void* self);
+	void				runJobs				();
+	void				runJob				(AsyncJob* job);
+
+	AsyncJob**			mpQueue;			// Ring buffer of pending jobs
+	int					mCapacity;
+	int					mHead;				// Next job to run
+	int					mCount;				// Number of queued jobs
+	bool				mBusy;				// Is the writer running a job?
+	bool				mStopping;
+	String				mError;				// First error since the last flush
+	pthread_t			mThread;
+	pthread_mutex_t		mMutex;
+	pthread_cond_t		mChanged;			// Signaled when the queue changes
+
+						AsyncWriter			(const AsyncWriter& other) {FORBIDDEN}
+};
+
+#endif
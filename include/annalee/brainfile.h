@@ -0,0 +1,137 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_BRAINFILE_H__
+#define __ANNALEE_BRAINFILE_H__
+
+#include <magic/mstring.h>
+
+// Externals
+class ANNetwork;
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//                ----            o        ----- o  |                       //
+//                |   )      ___      _    |        |  ___                  //
+//                |---< |/\  ___| |  |/ \  |---  |  | /   )                 //
+//                |   ) |   (   | |  |   | |     |  | |---                  //
+//                |___) |    \__| |  |   | |     |  |  \__                  //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Compact binary file format for trained neural networks.
+ *
+ * The file consists of a fixed header followed by the topology in
+ * compressed-row form and the weights:
+ *
+ * - start: first incoming connection of each unit, units+1 ints
+ * - source: source unit of each connection, connections ints
+ * - weight: weight of each connection, connections doubles
+ * - bias: bias of each unit, units doubles
+ *
+ * The offsets of the arrays are stored in the header, and the arrays
+ * are aligned to 8 bytes, so that a mapped file can be used directly
+ * without any parsing. The units are ordered as in the @ref
+ * ANNetwork the file was made of: inputs first and outputs last.
+ *
+ * All values are stored in the native byte order; the header records
+ * a byte order mark, so that files from other architectures are
+ * rejected instead of misread.
+ ******************************************************************************/
+class BrainFile {
+  public:
+
+	/** Maps a brain file for reading. */
+						BrainFile			(const String& filename);
+
+	/** Reads a brain from a memory buffer made with @ref pack. The
+	 *  buffer must be aligned to 8 bytes and outlive the object.
+	 **/
+						BrainFile			(const void* data, long length);
+						~BrainFile			();
+
+	int					units				() const {return mpHeader->units;}
+	int					inputs				() const {return mpHeader->inputs;}
+	int					outputs				() const {return mpHeader->outputs;}
+	int					connections			() const {return mpHeader->connections;}
+
+	/** First incoming connection of each unit, with a final element
+	 *  holding the number of connections.
+	 **/
+	const int*			start				() const {return mpStart;}
+	const int*			source				() const {return mpSource;}
+	const double*		weight				() const {return mpWeight;}
+	const double*		bias				() const {return mpBias;}
+
+	/** Creates a network with the topology and weights of the file. */
+	ANNetwork*			toNetwork			() const;
+
+	/** Saves a network in the binary format.
+	 *
+	 * @param inputs Number of input units at the beginning of the network.
+	 * @param outputs Number of output units at the end of the network.
+	 **/
+	static void			save				(const String& filename, const ANNetwork& net,
+											 int inputs, int outputs);
+
+	/** Lays out a network in the binary format in memory, for
+	 *  example for sending it to another process.
+	 *
+	 * @param length The length of the returned buffer is stored here.
+	 * @return The buffer, to be deleted by the caller with delete[].
+	 **/
+	static char*		pack				(const ANNetwork& net, int inputs, int outputs,
+											 long& length);
+
+	/** Header of a brain file. */
+	struct Header {
+		char		magic[8];		// "ANNBRN", zero-terminated
+		int			version;
+		int			byteOrder;		// 0x01020304 in the native order
+		int			units;
+		int			inputs;
+		int			outputs;
+		int			connections;
+		long long	startOffset;
+		long long	sourceOffset;
+		long long	weightOffset;
+		long long	biasOffset;
+	};
+
+  private:
+	bool				attach				(const void* data, long length);
+
+	void*				mpMap;				// Mapping of the file, or MAP_FAILED
+	long				mLength;
+	const Header*		mpHeader;
+	const int*			mpStart;
+	const int*			mpSource;
+	const double*		mpWeight;
+	const double*		mpBias;
+
+						BrainFile			(const BrainFile& other) {FORBIDDEN}
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "cangelosi.h"
 #include "nolfinet.h"
+#include "arena.h"
 
 class CangCellDescr;
 class CangelosiCell;
@@ -111,6 +112,12 @@ class CangelosiCell : public NolfiCell {
 	void					connect			(const Array<CangelosiCell>& cells,
 											 ANNetwork& ann) const;
 
+	/** The cells live only during the decoding, so they are
+	 *  allocated from the arena of the thread when decoding.
+	 **/
+	static void*			operator new	(size_t size) {return Arena::newObject (size);}
+	static void				operator delete	(void* cell) {Arena::deleteObject (cell);}
+
 	// Implementations
 	
 	/** Implementation */
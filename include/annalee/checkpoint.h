@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_CHECKPOINT_H__
+#define __ANNALEE_CHECKPOINT_H__
+
+#include <magic/mstring.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//            ___  |                 |              o                       //
+//           /   \ |      ___        |                  _    |              //
+//           |     |/ \  /   )  ___  | /  |--   __  |  |/ \  -+-            //
+//           |     |   | |---  /     |<   |  ) /  \ |  |   | |              //
+//           \___/ |   |  \__  \___  | \  |--  \__/ |  |   |  \             //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Writer of binary checkpoint files.
+ *
+ * A checkpoint is a set of tagged binary sections, such as the state
+ * of the environment or the packed genomes of a population. The
+ * sections are collected in memory and written at once with @ref
+ * write, which writes a temporary file and renames it over the
+ * previous checkpoint, so that a crash during the write leaves the
+ * previous checkpoint intact.
+ *
+ * The file begins with a header and a table of the sections, and the
+ * data of each section is aligned to 8 bytes, so that the arrays in
+ * the sections can be used directly from a memory-mapped @ref
+ * Checkpoint.
+ ******************************************************************************/
+class CheckpointWriter {
+  public:
+						CheckpointWriter	();
+						~CheckpointWriter	();
+
+	/** Adds a section with a copy of the given data.
+	 *
+	 *  @param tag Name of the section, at most 7 characters.
+	 **/
+	void				add					(const char* tag, const void* data, long size);
+
+	/** Adds a section of the given size and returns its data buffer,
+	 *  to be filled by the caller before @ref write.
+	 **/
+	void*				reserve				(const char* tag, long size);
+
+	/** Writes the checkpoint file atomically. */
+	void				write				(const String& filename) const;
+
+  private:
+	struct Section {
+		char	tag[8];
+		char*	data;
+		long	size;
+	};
+
+	Section*			mpSections;
+	int					mSections;
+	int					mCapacity;
+
+						CheckpointWriter	(const CheckpointWriter& other) {FORBIDDEN}
+};
+
+/*******************************************************************************
+ * Interface for the state of an evolution driver, such as its
+ * population, that is saved in the checkpoints of an environment.
+ * See @ref LearningEAEnv::setCheckpointSource.
+ ******************************************************************************/
+class CheckpointSource {
+  public:
+	virtual				~CheckpointSource	() {}
+
+	/** Adds the sections of the state to a checkpoint. */
+	virtual void		addCheckpointSections	(CheckpointWriter& writer) = 0;
+};
+
+/*******************************************************************************
+ * A checkpoint file mapped to memory for reading.
+ *
+ * Opening a checkpoint only maps the file and validates its section
+ * table, so even checkpoints of large populations open in constant
+ * time; the pages are read by the kernel when the sections are
+ * accessed.
+ ******************************************************************************/
+class Checkpoint {
+  public:
+						Checkpoint			(const String& filename);
+						~Checkpoint			();
+
+	/** Returns the data of the given section, or NULL if the
+	 *  checkpoint has no such section.
+	 *
+	 *  @param size If not NULL, the size of the section is stored
+	 *  here.
+	 **/
+	const void*			section				(const char* tag, long* size=NULL) const;
+
+	/** Checks if a checkpoint file exists. */
+	static bool			exists				(const String& filename);
+
+	/** Header of a checkpoint file. */
+	struct Header {
+		char		magic[8];		// "ANNCKPT", zero-terminated
+		int			version;
+		int			sections;
+	};
+
+	/** Entry of the section table that follows the header. */
+	struct Entry {
+		char		tag[8];
+		long long	offset;			// From the beginning of the file
+		long long	size;
+	};
+
+  private:
+	void*				mpMap;
+	long				mLength;
+	const Entry*		mpTable;
+	int					mSections;
+
+						Checkpoint			(const Checkpoint& other) {FORBIDDEN}
+};
+
+#endif
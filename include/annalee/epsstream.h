@@ -0,0 +1,113 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_EPSSTREAM_H__
+#define __ANNALEE_EPSSTREAM_H__
+
+#include <magic/mcoord.h>
+#include <magic/mturtle.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//           ----- ----   ___   ___                                         //
+//           |     |   ) (   \ (   \ |        ___   ___                     //
+//           |---  |---   \__   \__  -+- |/\ /   )  ___| |/\/\              //
+//           |     |         )     ) |   |   |---  (   | |  |  |            //
+//           |____ |     \___) \___)  \  |    \__   \__| |  |  |            //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Encapsulated PostScript drawing device that writes the picture
+ * directly to a file descriptor.
+ *
+ * Unlike EPSDevice, which collects the whole document in a string,
+ * the commands pass through a small fixed buffer, so drawing large
+ * cell spaces takes constant memory. The drawing operations are the
+ * subset of the EPSDevice interface used for the cell space pictures.
+ ******************************************************************************/
+class EPSStream {
+  public:
+
+	/** Writes the EPS header for a picture of the given size in
+	 *  points. The descriptor is not closed by the stream.
+	 **/
+						EPSStream			(int fd, const Coord2D& size);
+						~EPSStream			();
+
+	/** Scales the drawing area to the given logical size, draws a
+	 *  frame around it and clips the drawing inside the frame.
+	 **/
+	void				framedStyle			(double width, double height);
+
+	void				lineWidth			(double width);
+
+	/** Sets the line style: "solid", "dashed" or "dotted".
+	 *
+	 *  @param unit Length of the dashes in logical units.
+	 **/
+	void				lineStyle			(const char* style, double unit=1.0);
+
+	void				line				(const Coord2D& start, const Coord2D& end);
+	void				circle				(const Coord2D& center, double radius,
+											 bool filled=false);
+
+	/** Ends the document and flushes the buffered output. */
+	void				printFooter			();
+
+  private:
+	void				printf				(const char* fmt, ...);
+	void				flush				();
+
+	int					mFd;
+	Coord2D				mSize;
+	char				mBuffer[8192];
+	int					mUsed;
+	bool				mClipped;
+
+						EPSStream			(const EPSStream& other) {FORBIDDEN}
+};
+
+/*******************************************************************************
+ * Turtle device that draws the axon trees to an @ref EPSStream. The
+ * branch tips are drawn as circles of the tip radius.
+ ******************************************************************************/
+class EPSStreamTurtle : public TurtleDevice {
+  public:
+						EPSStreamTurtle		(EPSStream& stream, double tipRadius)
+								: mrStream (stream), mTipRadius (tipRadius) {}
+
+	virtual void		forwardLine			(const Coord2D& start, const Coord2D& end) {
+		mrStream.line (start, end);
+	}
+	virtual void		tip					(const Coord2D& point) {
+		mrStream.circle (point, mTipRadius);
+	}
+
+  private:
+	EPSStream&			mrStream;
+	double				mTipRadius;
+};
+
+#endif
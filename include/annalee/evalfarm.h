@@ -0,0 +1,134 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_EVALFARM_H__
+#define __ANNALEE_EVALFARM_H__
+
+#include <pthread.h>
+#include <sys/types.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//-----             |                 o             -----                   //
+//|            ___  |        ___  |            _    |      ___              //
+//|---  |   |  ___| | |   |  ___| -+- |   __  |/ \  |---   ___| |/\ |/\/\   //
+//|      \ /  (   | | |   | (   | |   |  /  \ |   | |     (   | |   |  |  | //
+//|____   V    \__| |  \__!  \__|  \  |  \__/ |   | |      \__| |   |  |  | //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * The work done by the worker processes of an @ref EvaluationFarm.
+ ******************************************************************************/
+class FarmTask {
+  public:
+	virtual				~FarmTask			() {}
+
+	/** Evaluates a serialized item. Called in a worker process.
+	 *  Exceptions are reported to the master as evaluation errors.
+	 **/
+	virtual double		evaluate			(const void* data, long length) = 0;
+};
+
+/*******************************************************************************
+ * Evaluation in local worker processes.
+ *
+ * The workers are forked when the farm is created, so they inherit
+ * the state of the master, such as the pattern sets, as copy-on-write
+ * memory that is loaded only once. The master sends serialized items
+ * to the workers through Unix domain socket pairs and the workers
+ * reply with the fitness values. The workers have their own address
+ * spaces and allocators, and can be pinned to processors so that they
+ * spread over NUMA nodes.
+ *
+ * @ref evaluate may be called from several threads at once; each
+ * call uses one free worker.
+ *
+ * A worker that dies, or whose socket fails, is retired and the
+ * evaluation it had is reported as failed. The workers are not
+ * forked again, as the master may have other threads running by
+ * then.
+ ******************************************************************************/
+class EvaluationFarm {
+  public:
+
+	/** Forks the worker processes.
+	 *
+	 * @param workers Number of worker processes.
+	 * @param task The work done by the workers.
+	 * @param pin Pin worker i to processor i modulo the number of processors.
+	 **/
+						EvaluationFarm		(int workers, FarmTask& task, bool pin=false);
+
+	/** Stops the workers and waits for them to exit. */
+						~EvaluationFarm		();
+
+	/** Evaluates one item in a free worker, waiting for the result.
+	 *
+	 *  @throws generic_exception if the evaluation failed in the
+	 *  worker, the worker died or no workers are left.
+	 **/
+	double				evaluate			(const void* data, long length);
+
+	/** Number of workers that are still alive. */
+	int					workers				() const {return mLive;}
+
+	/** Message from the master to a worker, followed by the data. */
+	struct Request {
+		int			id;
+		int			reserved;
+		long long	length;
+	};
+
+	/** Message from a worker to the master. */
+	struct Reply {
+		int			id;
+		int			failed;			// Did the evaluation throw?
+		double		result;
+	};
+
+  private:
+	struct Worker {
+		pid_t		pid;
+		int			fd;				// Master's end of the socket pair
+		bool		busy;
+		bool		retired;		// Died or lost its connection
+	};
+
+	static void			serve				(int fd, FarmTask& task);
+	void				send				(Worker& worker, int id, const void* data,
+											 long length);
+	Reply				receive				(Worker& worker);
+	void				retire				(Worker& worker);
+
+	Worker*				mpWorkers;
+	int					mWorkers;
+	int					mLive;				// Workers that are not retired
+	pthread_mutex_t		mMutex;
+	pthread_cond_t		mFreed;				// Signaled when a worker becomes free
+
+						EvaluationFarm		(const EvaluationFarm& other) {FORBIDDEN}
+};
+
+#endif
@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ANNALEE_GENERATIONAL_H__
+#define __ANNALEE_GENERATIONAL_H__
+
+#include <magic/mmap.h>
+#include "checkpoint.h"
+
+class Individual;
+class OStream;
+class LearningEAEnv;
+class NEATSpeciation;
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//   ___                                  o                  |  -----   _   //
+//  /   \  ___   _     ___       ___   |          _     ___  |  |      / \  //
+//  | __  /   ) |/ \  /   ) |/\  ___| -+- |  __  |/ \   ___| |  |---  /   \ //
+//  |   | |---  |   | |---  |   (   |  |  | /  \ |   | (   | |  |     |---| //
+//  \___/  \__  |   |  \__  |    \__|   \ | \__/ |   |  \__| |  |____ |   | //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Generational evolution in a @ref LearningEAEnv.
+ *
+ * Each generation is evaluated as a batch with @ref
+ * LearningEAEnv::evaluateAll, so the individuals are trained in
+ * parallel threads, or in the worker processes of the environment,
+ * with the largest networks first. The champion is then reported
+ * through the environment and the next generation is bred.
+ *
+ * The next generation consists of the elites of the previous one,
+ * which are not evaluated again, and of offspring produced by
+ * tournament selection, NEAT crossover when both parents have a NEAT
+ * brainplan, and point mutation. The best individual is always kept,
+ * so the champion that the environment refers to stays alive until
+ * the next report.
+ *
+ * When all the individuals have NEAT genomes, the population is
+ * divided into species with @ref NEATSpeciation before the breeding,
+ * and the tournaments compare fitness shared within the species, so
+ * that new structures are protected from the established ones
+ * (Stanley & Miikkulainen 2002, p. 110). As the fitness is an error,
+ * it is multiplied by the size of the species.
+ *
+ * Every individual draws its random numbers from its own streams,
+ * keyed by the seed of the run, the generation and its index in the
+ * population, so a run gives the same results however the
+ * evaluations are spread over threads and processes.
+ *
+ * The population is saved in the checkpoints of the environment. If
+ * the environment was restored from a checkpoint, the evolution
+ * continues from the population stored in it.
+ ******************************************************************************/
+class GenerationalEA : public CheckpointSource {
+  public:
+
+	/** Standard constructor.
+	 *
+	 * @param env The environment that evaluates the individuals.
+	 * @param params Dynamic parameter @ref String @ref Map.
+	 * @param params["GenerationalEA.size"] Population size. [Default=50]
+	 * @param params["GenerationalEA.maxGenerations"] Number of generations to run, including those before a restored checkpoint. [Default=100]
+	 * @param params["GenerationalEA.elites"] Number of the best individuals copied to the next generation, at least 1. [Default=1]
+	 * @param params["GenerationalEA.tournament"] Tournament size of the parent selection. [Default=3]
+	 * @param params["GenerationalEA.crossover"] Probability of crossover of NEAT parents. [Default=0.5]
+	 * @param params["GenerationalEA.mutationRate"] Point mutation rate. [Default=0.1]
+	 * @param params["GenerationalEA.speciation"] Whether NEAT genomes are speciated. The NEATSpeciation parameters apply. [Default=1]
+	 **/
+						GenerationalEA		(LearningEAEnv& env, const StringMap& params);
+						~GenerationalEA		();
+
+	/** Runs the evolution for the given number of generations.
+	 *
+	 * @param log Log stream for the reports of the environment.
+	 * @param out Output stream for the reports of the environment.
+	 **/
+	void				evolve				(OStream& log, OStream& out);
+
+	/** Number of evaluations completed so far. */
+	int					evaluations			() const {return mEvaluations;}
+
+	/** Fitness of the best individual, smaller is better. */
+	double				bestFitness			() const;
+
+	/** Number of species in the latest breeding, 0 if the
+	 *  population was not speciated.
+	 **/
+	int					species				() const;
+
+	/** Implementation for @ref CheckpointSource. Adds the evaluated
+	 *  population with its fitness values.
+	 **/
+	virtual void		addCheckpointSections	(CheckpointWriter& writer);
+
+  private:
+	void				initialize			();
+	void				breed				();
+	Individual*			offspring			() const;
+	void				shareFitness		();
+	int					tournament			() const;
+	void				findBest			();
+	void				restore				(const Checkpoint& checkpoint);
+
+	LearningEAEnv&		mrEnv;
+	Individual**		mpPopulation;		// The elites first
+	double*				mpFitness;
+	double*				mpShared;			// Fitness shared within species, for the selection
+	NEATSpeciation*		mpSpeciation;		// NULL if speciation is disabled
+	bool				mSpeciated;			// The latest breeding was speciated
+	int					mMembers;
+	int					mEvaluated;			// Members that have been evaluated
+	int					mSize;				// Population size
+	int					mMaxGenerations;
+	int					mElites;
+	int					mTournament;
+	double				mCrossover;
+	double				mMutationRate;
+	int					mEvaluations;
+	int					mBest;				// Index of the best member
+
+						GenerationalEA		(const GenerationalEA& other) : mrEnv (other.mrEnv) {FORBIDDEN}
+};
+
+#endif
@@ -25,11 +25,19 @@
 #ifndef __NEURALENV__
 #define __NEURALENV__
 
+#include <pthread.h>
 #include <nhp/gaenvrnmt.h>
 #include <inanna/patternset.h>
 
 // Externals
 class PatternSet;
+class Checkpoint;
+class CheckpointWriter;
+class CheckpointSource;
+class AsyncWriter;
+class ANNetwork;
+class FarmTask;
+class EvaluationFarm;
 template<class K, class V> class Map;
 //typedef Map<String,String> StringMap;
 
@@ -45,6 +53,7 @@ template<class K, class V> class Map;
  ******************************************************************************/
 class LearningEAEnv : public EAEnvironment {
 	decl_dynamic (LearningEAEnv);
+	friend class LearningFarmTask;
   public:
 
 						LearningEAEnv	();
@@ -52,6 +61,7 @@ class LearningEAEnv : public EAEnvironment {
 										 const PatternSet& evaluationset,
 										 const PatternSet& reportset,
 										 StringMap& params);
+						~LearningEAEnv	();
 
 	/** Sets problem type to be a classification task or a function
      *    approximation task.
@@ -82,14 +92,117 @@ class LearningEAEnv : public EAEnvironment {
 	/** Implementation for @ref EAEnvironment. */
 	virtual double		evaluateg		(const Individual& genome);
 
+	/** Evaluates a generation of individuals in parallel with @ref
+	 *  evaluateg. The largest networks are trained first and idle
+	 *  threads steal the remaining ones, so that the stragglers do
+	 *  not keep the other processors waiting at the end of the
+	 *  generation. This is how @ref GenerationalEA evaluates its
+	 *  generations.
+	 *
+	 *  @param fitness Array of n elements for the fitness values.
+	 **/
+	void				evaluateAll		(const Individual* const* individuals, int n,
+										 double* fitness);
+
 	/** Implementation for @ref Object. */
 	virtual DataOStream& operator>>		(DataOStream& out) const;
 
 	/** Implementation for @ref Object. */
 	virtual void		check			() const;
 
+	/** Number of generations reported so far, including the
+	 *  generations before a restored checkpoint. Read atomically,
+	 *  as the report increments it while evaluations are running.
+	 **/
+	int					generation		() const {return __atomic_load_n (&mGeneration, __ATOMIC_SEQ_CST);}
+
+	/** Seed of the random streams of the run. The streams of the
+	 *  individuals are keyed by the seed, the generation and the
+	 *  individual; see @ref RandomStream.
+	 **/
+	unsigned int		seed			() const {return mSeed;}
+
+	/** Returns the checkpoint the run was restored from, or NULL if
+	 *  the run was started from scratch. The evolution driver can
+	 *  read its own sections, such as the population, from it.
+	 **/
+	const Checkpoint*	restored		() const {return mpRestored;}
+
+	/** Sets the individual that @ref cycle_report reports, for
+	 *  evolution drivers that keep their own population. The
+	 *  individual is not owned by the environment.
+	 **/
+	void				setChampion		(Individual* champion) {mpBest = champion;}
+
+	/** Sets the state of the evolution driver, such as its
+	 *  population, that is added to the checkpoints. NULL removes
+	 *  it. The driver reads its sections back from @ref restored.
+	 **/
+	void				setCheckpointSource (CheckpointSource* source) {mpCheckpointSource = source;}
+
+	/** Adds the genomes of individuals to a checkpoint as a single
+	 *  section, to be read back with @ref restoreGenomes.
+	 *
+	 *  The "brainplan" genes are stored with @ref ANNEncoding::pack.
+	 *  Throws generic_exception if an encoding can't be packed.
+	 *
+	 *  @param fitness Fitness of each individual, stored with the
+	 *  genomes, or NULL.
+	 *  @return The number of genomes stored.
+	 **/
+	int					addGenomes		(CheckpointWriter& writer, const char* tag,
+										 const Individual* const* individuals,
+										 const double* fitness, int n) const;
+
+	/** Creates decoded individuals from a section written by @ref
+	 *  addGenomes. The individuals are not evaluated.
+	 *
+	 *  @param individuals Array for at most max new individuals,
+	 *  owned by the caller.
+	 *  @param fitness Array for the stored fitness values, or NULL.
+	 *  @return The number of individuals created, 0 if there is no
+	 *  such section.
+	 **/
+	int					restoreGenomes	(const Checkpoint& checkpoint, const char* tag,
+										 Individual** individuals, double* fitness,
+										 int max);
+
+	/** Number of worker processes that evaluate the individuals,
+	 *  0 if they are evaluated in this process.
+	 **/
+	int					workers			() const;
+
+	/** Writes a checkpoint file with the sections from @ref
+	 *  addCheckpointSections. Called automatically from @ref
+	 *  cycle_report at the checkpoint interval.
+	 **/
+	void				saveCheckpoint	();
+
+	/** Draws the pictures of the latest champion to a directory.
+	 *  Called automatically from @ref cycle_report at the picture
+	 *  interval.
+	 *
+	 *  @param decode Decode the genome again for the pictures
+	 *  specific to the encoding, in addition to the pictures of the
+	 *  network.
+	 **/
+	void				drawPictures	(const String& dir, bool decode=true);
+
   protected:
 
+	/** Adds the sections of the environment state to a checkpoint:
+	 *  the generation counter, the random seed, the split of the
+	 *  training data, the NEAT innovation counters and the genome of
+	 *  the best individual, followed by the sections of the @ref
+	 *  CheckpointSource. Subclasses can add their own sections.
+	 **/
+	virtual void		addCheckpointSections (CheckpointWriter& writer);
+
+	/** Restores the environment state from a checkpoint, including
+	 *  the best individual if its encoding could be stored.
+	 **/
+	virtual void		restoreCheckpoint (const Checkpoint& checkpoint);
+
 	/** Permutates and redivides the mTrainData into mTrainSet and
 		mEvaluationSet.
 	**/
@@ -98,6 +211,22 @@ class LearningEAEnv : public EAEnvironment {
 	/** Resplit the dataset into training set and evaluation set */
 	void				splitTrainData	();
 	Trainer*			createTrainer	() const;
+	ANNetwork*			trainBrain		(const ANNetwork& brainplan) const;
+
+	/** Cache of the network trained in the evaluation of the fittest
+	 *  individual of the generation, so that the champion does not
+	 *  need to be trained again for the report. Cleared by each
+	 *  report.
+	 **/
+	void				keepTrained		(const Individual& ind, const ANNetwork& brainplan,
+										 ANNetwork* brain, double fitness);
+	ANNetwork*			takeTrained		(const Individual& ind, int generation, double& fitness);
+	void				clearTrained	();
+
+	void				rememberChampion ();
+
+	/** The stats of an individual printed after its evaluation. */
+	String				statsLine		(const Individual& ind) const;
 	
   private:
 	PatternSet			mTrainData;		// Full training data
@@ -113,6 +242,36 @@ class LearningEAEnv : public EAEnvironment {
 	int					mValidInterval;	// Training termination check interval
 	String				mTermMethod;	// Termination method name (default=UP2)
 	bool				mPermutate;		// Permutate training data during evolution
+	int					mGeneration;	// Number of reported generations, changed atomically
+	unsigned int		mSeed;			// Seed of the random streams
+	String				mCheckpointFile;// Checkpoint file name, empty if disabled
+	int					mCheckpointInterval; // Generations between checkpoints
+	Checkpoint*			mpRestored;		// Checkpoint the run was restored from
+	Individual*			mpRestoredBest;	// Best individual of the checkpoint
+	CheckpointSource*	mpCheckpointSource; // State of the evolution driver
+	String				mBrainFormat;	// Format of the saved best network
+	AsyncWriter*		mpWriter;		// Background writer of the reports
+
+	/** A network trained in the evaluation of an individual. */
+	struct TrainedBrain {
+		int					generation;	// Generation of the evaluation
+		const Individual*	individual;
+		unsigned long long	genome;		// Tells apart individuals at a reused address
+		ANNetwork*			brain;		// NULL if there is none
+		double				fitness;
+	};
+	TrainedBrain		mTrained;		// Network of the fittest individual of the generation
+	pthread_mutex_t		mTrainedMutex;	// Evaluations may run in parallel
+	pthread_mutex_t		mOutputMutex;	// Keeps the stats of parallel evaluations on their own lines
+	bool				mDeferStats;	// evaluateAll prints the stats in order
+
+	int					mPictureInterval; // Generations between champion pictures
+	String				mPictureDetail;	// "all" or "network"
+	Genstruct*			mpChampionPlan;	// Copy of the brainplan gene of the champion
+	ANNetwork*			mpChampionNet;	// Copy of the decoded network of the champion
+	bool				mChampionRecurrent;	// The champion was evaluated as a NEATNetwork
+	FarmTask*			mpFarmTask;		// Work of the evaluation worker processes
+	EvaluationFarm*		mpFarm;			// Worker processes, NULL if not used
 };
 
 #endif
@@ -25,7 +25,85 @@
 #ifndef __ANNALEE_NEAT_H__
 #define __ANNALEE_NEAT_H__
 
+#include <pthread.h>
 #include "anngenes.h"
+#include "neatgenome.h"
+
+/*******************************************************************************
+ * Registry of structural innovations in NEAT.
+ *
+ * Identical structural mutations that occur during the same
+ * generation must receive the same innovation numbers, so that the
+ * corresponding genes can be aligned in crossover (Stanley &
+ * Miikkulainen 2002, p. 108). The registry maps a (source, target)
+ * node pair to the innovation number of the connection and to the
+ * node that was inserted when splitting such a connection.
+ *
+ * The lookups are done in open-addressed hash tables, so each
+ * mutation costs O(1) regardless of the population size. All the
+ * public methods are serialized with a mutex, so the registry can be
+ * used from parallel mutation workers.
+ ******************************************************************************/
+class NEATInnovations {
+  public:
+						NEATInnovations		();
+						~NEATInnovations	();
+
+	/** Returns the innovation number of a connection between the
+	 *  given nodes, allocating a new number if the connection has not
+	 *  been created during this generation.
+	 **/
+	int					connection			(int source, int target);
+
+	/** Returns the identifier of the node that splits the connection
+	 *  between the given nodes, allocating a new node if the same
+	 *  connection has not been split during this generation.
+	 **/
+	int					splitNode			(int source, int target);
+
+	/** Makes sure that innovation numbers and node identifiers
+	 *  below the given values are never allocated. Used for the
+	 *  fixed input and output nodes.
+	 **/
+	void				reserve				(int innovations, int nodes);
+
+	/** Forgets the innovations of the previous generation. The
+	 *  counters are not reset.
+	 **/
+	void				newGeneration		();
+
+	/** The next innovation number and node identifier to be
+	 *  allocated, for checkpointing.
+	 **/
+	int					nextInnovation		() const {return mNextInnovation;}
+	int					nextNode			() const {return mNextNode;}
+
+  private:
+	struct Slot {
+		long long	key;	// (source<<32 | target), -1 for an empty slot
+		int			value;
+	};
+
+	/** A single open-addressed table from node pairs to values. */
+	struct Table {
+		Slot*	mpSlots;
+		int		mCapacity;	// Always a power of two
+		int		mUsed;
+	};
+
+	int					lookup				(Table& table, int source, int target,
+											 int& counter);
+	void				clear				(Table& table);
+	void				grow				(Table& table);
+
+	Table				mConnections;		// (source,target) -> innovation
+	Table				mSplits;			// (source,target) -> node id
+	int					mNextInnovation;
+	int					mNextNode;
+	pthread_mutex_t		mMutex;
+
+						NEATInnovations		(const NEATInnovations& other) {FORBIDDEN}
+};
 
 /*******************************************************************************
  * NEAT encoding for neural networks.
@@ -35,56 +113,14 @@
  *   through Augmenting Topologies, 2002.
  * - Kenneth O. Stanley, Efficient Evolution of Neural Networks
  *   through Complexification, Report AI-TR-04-314 August 2004.
+ *
+ * The node and connection genes are not stored as separate gene
+ * objects, but in a flat @ref NEATGenome sorted by innovation
+ * number, so that crossover and compatibility distance are linear
+ * merges over contiguous memory.
  ******************************************************************************/
 class NEATEncoding : public ANNEncoding {
 	decl_dynamic (NEATEncoding);
-  public:
-
-	/**
-	 * Gene for a single NEAT node, that is, a neuron.
-	 *
-	 * Nodes can be input, output, or hidden nodes.
-	 **/
-	class NodeGene : public Gentainer {
-		decl_dynamic (NodeGene);
-	  public:
-							NodeGene			(const GeneticID& name=NULL);
-							NodeGene			(const NodeGene& orig);
-	
-		/** Implementation for @ref Genstruct. */
-		virtual void		init				();
-	
-		/** Implementation for @ref Genstruct. */
-		virtual void		copy				(const Genstruct& other) {Gentainer::copy (other);}
-	
-		/** Implementation for @ref Genstruct. */
-		virtual void		addPrivateGenes		(Gentainer& g, const StringMap& params);
-	};
-
-	/**
-	 * Gene for a NEAT node connection.
-	 *
-	 * Connections are between two neurons and have a weight. A
-	 * connection is expressed only if it is enabled. The special
-	 * feature of NEAT connections is that they have an "innovation
-	 * number", which is used to find corresponding genes during
-	 * crossover.
-	 **/
-	class ConnectionGene : public Gentainer {
-		decl_dynamic (ConnectionGene);
-	  private:
-		const int mInnovation;
-		int       mSource;
-		int       mTarget;
-	  public:
-							ConnectionGene		(const GeneticID& name=NULL, int innovation=0, int source=0, int target=0);
-							ConnectionGene		(const ConnectionGene& orig);
-	
-		virtual void		init				();
-		virtual void		copy				(const Genstruct& other) {Gentainer::copy (other);}
-		virtual void		addPrivateGenes		(Gentainer& g, const StringMap& params);
-	};
-	
   public:
 						NEATEncoding 		() {FORBIDDEN}
 						NEATEncoding		(const GeneticID& name,
@@ -111,8 +147,48 @@ class NEATEncoding : public ANNEncoding {
 	/** Implementation for @ref Genstruct. */
 	virtual bool		pointMutate			(const MutationRate& r);
 
+	/** Implementation for @ref Object. */
+	virtual void		check				() const;
+
+	/** Implementation for @ref ANNEncoding. The genome is packed
+	 *  with @ref NEATGenome::pack.
+	 **/
+	virtual long		packedSize			() const {return mGenome.packedSize ();}
+	virtual void		pack				(void* buffer) const {mGenome.pack (buffer);}
+	virtual void		unpack				(const void* buffer, long size) {mGenome.unpack (buffer, size);}
+
+	/** Makes this genome an offspring of two NEAT parents. See @ref
+	 *  NEATGenome::crossover.
+	 **/
+	void				crossover			(const NEATEncoding& fitter,
+											 const NEATEncoding& other);
+
+	/** Returns the genes of the genome. */
+	const NEATGenome&	genome				() const {return mGenome;}
+
+	/** Tells the innovation registry that a new generation has
+	 *  begun. Should be called once per generation by the
+	 *  environment.
+	 **/
+	static void			newGeneration		() {smInnovations.newGeneration ();}
+
+	/** Returns the global innovation registry. */
+	static NEATInnovations&	innovations		() {return smInnovations;}
+
   protected:
-	int mInnovationCounter;
+	bool				addConnection		();
+	bool				addNode				();
+	bool				reachable			(int from, int to) const;
+
+	NEATGenome			mGenome;			// Node and connection genes
+	double				mAddConnRate;		// Probability of the add-connection mutation
+	double				mAddNodeRate;		// Probability of the add-node mutation
+	double				mWeightVariance;	// Variance of the weight perturbation
+	double				mToggleRate;		// Probability of flipping the enabled bit
+	bool				mRecurrent;			// Allow recurrent connections
+	int					mRelaxation;		// Relaxation steps of the recurrent phenotype
+
+	static NEATInnovations	smInnovations;	// Global innovation registry
 };
 
 #endif
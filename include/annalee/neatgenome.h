@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_NEATGENOME_H__
+#define __ANNALEE_NEATGENOME_H__
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//     |   | -----   _   -----     ___                                      //
+//     |\  | |      / \    |      /   \  ___   _                  ___       //
+//     | \ | |---  /   \   |      | __  /   ) |/ \   __  |/\/\   /   )      //
+//     |  \| |     |---|   |      |   | |---  |   | /  \ |  |  | |---       //
+//     |   | |____ |   |   |      \___/  \__  |   | \__/ |  |  |  \__       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Flat storage for the genes of a NEAT genome.
+ *
+ * The connection genes are stored in contiguous arrays sorted by
+ * innovation number, one array for each field: innovation number,
+ * source node, target node, weight, and the enabled bit. Finding the
+ * corresponding genes of two genomes, as in crossover or when
+ * computing the compatibility distance, is thus a linear merge over
+ * the innovation arrays.
+ *
+ * The hidden node identifiers are stored in a sorted array. The input
+ * and output nodes are not stored, as they are the same in all
+ * genomes: nodes 0...inputs-1 are inputs and the next outputs nodes
+ * are outputs.
+ ******************************************************************************/
+class NEATGenome {
+  public:
+						NEATGenome			();
+						NEATGenome			(const NEATGenome& other);
+						~NEATGenome			();
+	NEATGenome&			operator=			(const NEATGenome& other);
+
+	// Connection genes
+
+	/** Number of connection genes. */
+	int					size				() const {return mSize;}
+	int					innovation			(int i) const {return mpInnovation[i];}
+	int					source				(int i) const {return mpSource[i];}
+	int					target				(int i) const {return mpTarget[i];}
+	double				weight				(int i) const {return mpWeight[i];}
+	bool				enabled				(int i) const {return mpEnabled[i];}
+	void				setWeight			(int i, double w) {mpWeight[i] = w;}
+	void				enable				(int i, bool e) {mpEnabled[i] = e;}
+
+	/** Direct access to the innovation number array. */
+	const int*			innovations			() const {return mpInnovation;}
+
+	/** Inserts a connection gene at its place in the innovation
+	 *  order. Appending a gene with the highest innovation number,
+	 *  which is the usual case, costs O(1).
+	 *
+	 *  @return Index of the new gene.
+	 **/
+	int					add					(int innovation, int source, int target,
+											 double weight, bool enabled=true);
+
+	/** Finds the gene with the given innovation number with a binary
+	 *  search.
+	 *
+	 *  @return Index of the gene, or -1 if there is no such gene.
+	 **/
+	int					find				(int innovation) const;
+
+	/** Checks if there is a connection gene, enabled or not, between
+	 *  the given nodes.
+	 **/
+	bool				contains			(int source, int target) const;
+
+	/** Removes all the genes. */
+	void				clear				();
+
+	// Hidden node genes
+
+	/** Number of hidden node genes. */
+	int					nodes				() const {return mNodes;}
+	int					node				(int i) const {return mpNodes[i];}
+	void				addNode				(int id);
+	bool				hasNode				(int id) const {return findNode (id) != -1;}
+
+	/** Finds the index of the hidden node with the given identifier
+	 *  with a binary search, or -1 if there is no such node.
+	 **/
+	int					findNode			(int id) const;
+
+	// Genetic operations
+
+	/** Makes this genome an offspring of the two parents.
+	 *
+	 * Matching genes are inherited randomly from either parent, while
+	 * disjoint and excess genes are inherited from the fitter
+	 * parent. A gene that is disabled in either parent is disabled in
+	 * the offspring with probability 0.75 (Stanley & Miikkulainen
+	 * 2002, p. 109).
+	 **/
+	void				crossover			(const NEATGenome& fitter,
+											 const NEATGenome& other);
+
+	/** Compatibility distance to another genome (Stanley &
+	 *  Miikkulainen 2002, p. 110).
+	 *
+	 *  @param c1 Coefficient of the excess genes.
+	 *  @param c2 Coefficient of the disjoint genes.
+	 *  @param c3 Coefficient of the average weight difference of the
+	 *         matching genes.
+	 **/
+	double				distance			(const NEATGenome& other,
+											 double c1, double c2, double c3) const;
+
+	/** Compatibility distance between two gene lists given as raw
+	 *  innovation and weight arrays, both sorted by innovation
+	 *  number. Used for comparing against cached gene lists.
+	 **/
+	static double		distance			(const int* innovA, const double* weightA, int sizeA,
+											 const int* innovB, const double* weightB, int sizeB,
+											 double c1, double c2, double c3);
+
+	/** Direct access to the weight array. */
+	const double*		weights				() const {return mpWeight;}
+
+	// Serialization
+
+	/** Size of the packed genome in bytes. */
+	long				packedSize			() const;
+
+	/** Packs the genome to a buffer of @ref packedSize bytes. The
+	 *  buffer must be aligned to 8 bytes.
+	 **/
+	void				pack				(void* buffer) const;
+
+	/** Replaces the genome with a packed one. */
+	void				unpack				(const void* buffer, long size);
+
+	void				check				() const;
+
+  private:
+	void				reserve				(int capacity);
+	void				reserveNodes		(int capacity);
+
+	int					mSize;
+	int					mCapacity;
+	int*				mpInnovation;	//< Innovation numbers, ascending.
+	int*				mpSource;		//< Source node of each connection.
+	int*				mpTarget;		//< Target node of each connection.
+	double*				mpWeight;		//< Connection weights.
+	bool*				mpEnabled;		//< Is the connection expressed?
+
+	int					mNodes;
+	int					mNodeCapacity;
+	int*				mpNodes;		//< Hidden node identifiers, ascending.
+};
+
+#endif
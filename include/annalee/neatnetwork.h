@@ -0,0 +1,168 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_NEATNETWORK_H__
+#define __ANNALEE_NEATNETWORK_H__
+
+#include <inanna/patternset.h>
+#include "neatgenome.h"
+
+// Externals
+class ANNetwork;
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//       |   | -----   _   ----- |   |                            |         //
+//       |\  | |      / \    |   |\  |  ___  |                    |         //
+//       | \ | |---  /   \   |   | \ | /   ) -+- |     |  __  |/\ | /       //
+//       |  \| |     |---|   |   |  \| |---  |   |  |  | /  \ |   |<        //
+//       |   | |____ |   |   |   |   |  \__   \   \/ \/  \__/ |   | \       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Compiled phenotype of a possibly recurrent NEAT genome.
+ *
+ * The units are stored in a fixed activation order: inputs, hidden
+ * units in topological order, outputs. The incoming connections of
+ * the units are kept in flat compressed-row arrays, so an activation
+ * step is a single pass over two contiguous arrays.
+ *
+ * The state is double-buffered. A connection from a unit earlier in
+ * the activation order reads the value computed during the current
+ * step, while a recurrent connection (from the same or a later unit)
+ * reads the value of the previous step. A feed-forward network thus
+ * settles in one step; recurrent networks are relaxed for a given
+ * number of steps per input pattern.
+ ******************************************************************************/
+class NEATNetwork : public Object {
+  public:
+
+	/** Compiles the enabled connections of the genome.
+	 *
+	 * @param genome The genome to express.
+	 * @param inputs Number of input units.
+	 * @param outputs Number of output units.
+	 * @param steps Number of relaxation steps per activation.
+	 **/
+						NEATNetwork			(const NEATGenome& genome, int inputs,
+											 int outputs, int steps=1);
+
+	/** Adopts a network that has already been compiled to
+	 *  compressed-row form, for example by @ref SubstrateEncoding.
+	 *
+	 * @param start First incoming connection of each unit, with a
+	 *        final element holding the total number of connections.
+	 * @param source Source unit index of each connection.
+	 * @param weight Weight of each connection.
+	 *
+	 * The units are ordered as inputs, hiddens, outputs. The arrays
+	 * must have been allocated with new[] and are owned by the
+	 * network afterwards.
+	 **/
+						NEATNetwork			(int inputs, int hiddens, int outputs,
+											 int* start, int* source, double* weight,
+											 int steps=1);
+						~NEATNetwork		();
+
+	/** Clears the state of all the units. */
+	void				reset				();
+
+	/** Feeds an input vector to the network and relaxes it.
+	 *
+	 * @param input Array of @ref inputs() values.
+	 * @return Array of @ref outputs() values, valid until the next
+	 *         activation.
+	 **/
+	const double*		activate			(const double* input);
+
+	/** Returns the mean squared error of the network over the given
+	 *  patterns. The relaxation starts from a cleared state for
+	 *  each pattern.
+	 *
+	 * @param failures If given, set to the number of misclassified
+	 *        patterns: the largest output decides the class, or the
+	 *        threshold 0.5 if there is only one output.
+	 **/
+	double				test				(const PatternSet& set, int* failures=NULL) const;
+
+	int					inputs				() const {return mInputs;}
+	int					outputs				() const {return mOutputs;}
+	int					units				() const {return mUnits;}
+	int					connections			() const {return mpStart[mUnits];}
+	int					steps				() const {return mSteps;}
+
+	/** Connects the units of the given network like the forward
+	 *  connections of this network, with the same weights.
+	 *
+	 * @param recurrent Connect also the recurrent connections. The
+	 *        result is then only good for drawing, as @ref ANNetwork
+	 *        can't relax them.
+	 * @return The number of connections made.
+	 **/
+	int					connect				(ANNetwork& net, bool recurrent=false) const;
+
+	/** Returns a listing of the units and the connections, one
+	 *  connection per line.
+	 **/
+	String				toString			() const;
+
+	/** Computes the activation order of the hidden nodes of the
+	 *  genome.
+	 *
+	 * The hidden nodes are sorted topologically; if the genome has
+	 * cycles, the node with fewest unplaced hidden sources is placed
+	 * whenever no node is free, which breaks the cycle there.
+	 *
+	 * @param order Array of genome.nodes() elements, where the unit
+	 *        index of each hidden node is stored, in the order of
+	 *        the node list of the genome.
+	 * @return True if the genome had no cycles between hidden nodes.
+	 **/
+	static bool			activationOrder		(const NEATGenome& genome, int inputs,
+											 int* order);
+
+	/** Maps a node identifier of the genome to a unit index. */
+	static int			unitIndex			(const NEATGenome& genome, int inputs,
+											 int outputs, const int* order, int node);
+
+	/** Implementation for @ref Object. */
+	virtual void		check				() const;
+
+  private:
+	const double*		relax				(const double* input, double* buffer) const;
+
+	int					mInputs;
+	int					mOutputs;
+	int					mUnits;
+	int					mSteps;
+	int*				mpStart;		//< First incoming connection of each unit, mUnits+1 elements
+	int*				mpSource;		//< Source of each connection in mpBuffer
+	double*				mpWeight;		//< Weight of each connection
+	double*				mpBuffer;		//< Previous state followed by the current state
+
+						NEATNetwork			(const NEATNetwork& other) {FORBIDDEN}
+};
+
+#endif
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_NEATSPECIES_H__
+#define __ANNALEE_NEATSPECIES_H__
+
+#include "neatgenome.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//             ___                   o            o                         //
+//            (   \       ___            ___  |            _                //
+//             \__  |--  /   )  ___  |   ___| -+- |   __  |/ \              //
+//                ) |  ) |---  /     |  (   | |   |  /  \ |   |             //
+//            \___) |--   \__  \___  |   \__|  \  |  \__/ |   |             //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Speciation of a population of NEAT genomes.
+ *
+ * Each genome is placed in the first species whose representative is
+ * within the compatibility threshold, or in a new species if no such
+ * species exists (Stanley & Miikkulainen 2002, p. 110). The
+ * representatives are random members of the species from the
+ * previous generation.
+ *
+ * The innovation and weight arrays of the representatives are cached
+ * in the speciation object, so they do not need to be collected from
+ * the genomes for every comparison. The distances of the genomes to
+ * the existing species are computed in parallel threads; only the
+ * genomes that start new species are handled serially.
+ ******************************************************************************/
+class NEATSpeciation {
+  public:
+
+	/** Standard constructor.
+	 *
+	 * @param params Dynamic parameter @ref String @ref Map.
+	 * @param params["NEATSpeciation.threshold"] Compatibility threshold. [Default=3.0]
+	 * @param params["NEATSpeciation.c1"] Coefficient of the excess genes. [Default=1.0]
+	 * @param params["NEATSpeciation.c2"] Coefficient of the disjoint genes. [Default=1.0]
+	 * @param params["NEATSpeciation.c3"] Coefficient of the weight differences. [Default=0.4]
+	 * @param params["NEATSpeciation.threads"] Number of threads, 0 for the number of processors. [Default=0]
+	 **/
+						NEATSpeciation		(const StringMap& params);
+						~NEATSpeciation		();
+
+	/** Assigns each of the genomes to a species.
+	 *
+	 * @param genomes The genomes of the population.
+	 * @param n Number of genomes.
+	 * @param species Array of n elements where the species index of
+	 *        each genome is stored.
+	 **/
+	void				speciate			(const NEATGenome* const* genomes, int n,
+											 int* species);
+
+	/** Number of species after the latest speciation. */
+	int					species				() const {return mSpecies;}
+
+	/** Number of members in the given species, for fitness sharing. */
+	int					members				(int s) const {return mpReps[s].members;}
+
+	void				check				() const;
+
+  private:
+	/** Cached gene list of a species representative. */
+	struct Representative {
+		int		size;
+		int*	innovations;
+		double*	weights;
+		int		members;
+	};
+
+	/** Work unit of a speciation thread. */
+	struct Work {
+		NEATSpeciation*			self;
+		const NEATGenome* const* genomes;
+		int*					species;
+		int						begin, end;
+	};
+
+	static void*		classifyThread		(void* work);
+	void				classify			(const NEATGenome* const* genomes,
+											 int* species, int begin, int end) const;
+	int					findSpecies			(const NEATGenome& genome, int from) const;
+	void				setRepresentative	(int s, const NEATGenome& genome);
+	void				addSpecies			(const NEATGenome& genome);
+
+	Representative*		mpReps;
+	int					mSpecies;
+	int					mCapacity;
+	double				mThreshold;
+	double				mC1, mC2, mC3;
+	int					mThreads;
+
+						NEATSpeciation		(const NEATSpeciation& other) {FORBIDDEN}
+};
+
+#endif
@@ -29,6 +29,7 @@
 #include "annalee/nolfi.h"
 
 class NolfiNet;
+class EPSStream;
 
 // Externals
 namespace MagiC {
@@ -64,7 +65,7 @@ class NolfiCell : public Object {
 											 int xsize, int ysize, const StringMap& params);
 	void					make			();
 	void					decodeFrom		(const Gentainer& g, int i);
-	void					developAxon		(Array<Coord2D>& result, double scale) const;
+	int						developAxon		(const Coord2D*& result, double scale) const;
 
 	// Access functions
 
@@ -111,6 +112,9 @@ class NolfiCell : public Object {
 	 **/
 	void					drawEPS			(EPSDevice& dc, double scale) const;
 
+	/** Draws the cell like @ref drawEPS, but to a streaming device. */
+	void					drawEPS			(EPSStream& dc, double scale) const;
+
 	/** Implementation for @ref Object. */
 	void					check			() const;
 
@@ -169,6 +173,12 @@ class NolfiNet : public Object {
 	
 	virtual OStream&		operator>>			(OStream& out) const;
 	String					drawEPS				() const;
+
+	/** Draws the cell space like @ref drawEPS(), but writes the
+	 *  picture directly to a file descriptor, without building it in
+	 *  memory.
+	 **/
+	void					drawEPS				(int fd) const;
 	
   protected:
 	Array<NolfiCell>	cells;			//< The cells in the cell space
@@ -0,0 +1,144 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ANNALEE_RANDOMSTREAM_H__
+#define __ANNALEE_RANDOMSTREAM_H__
+
+#include <inanna/initializer.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//----                  |                  ___                              //
+//|   )  ___   _        |                 (   \ |        ___   ___          //
+//|---'  ___| |/ \   ---|  __  |/\/\       \__  -+- |/\ /   )  ___| |/\/\   //
+//|  \  (   | |   | (   | /  \ |  |  |        ) |   |   |---  (   | |  |  | //
+//|   \  \__| |   |  ---| \__/ |  |  |    \___)  \  |    \__   \__| |  |  | //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Identifies a random number stream: the same key always gives the
+ * same sequence of numbers.
+ ******************************************************************************/
+struct RandomKey {
+	unsigned int	seed;			// Seed of the run
+	int				generation;
+	int				individual;		// Identifier of the individual in the generation
+	int				purpose;		// One of the RandomStream::purposes
+};
+
+/*******************************************************************************
+ * Counter-based random number generator.
+ *
+ * The n:th number of a stream is a hash of the key of the stream and
+ * n, so the numbers do not depend on anything else that was drawn
+ * before, in this or in any other thread. When each individual
+ * draws its numbers from its own stream, the results of a run are
+ * identical however the individuals are spread over threads or
+ * processes.
+ *
+ * The hash is the finalizer of SplitMix64, which passes the usual
+ * statistical tests for counter-based generation.
+ ******************************************************************************/
+class RandomStream {
+  public:
+
+	/** The separate streams of an individual. */
+	enum purposes {NONE=0, INITIALIZATION, SELECTION, VARIATION, DECODING, TRAINING};
+
+						RandomStream		(const RandomKey& key);
+
+	/** The next 64 random bits. */
+	unsigned long long	next				() {return mix (mKey + 0x9e3779b97f4a7c15ULL * ++mCounter);}
+
+	/** Uniform random number in [0,1). */
+	double				uniform				() {return (next () >> 11) * (1.0/9007199254740992.0);}
+
+	/** Uniform random integer in [0,n). */
+	int					integer				(int n) {return int (uniform () * n);}
+
+	/** Normally distributed random number with zero mean, scaled
+	 *  like the argument of gaussrnd.
+	 **/
+	double				gaussian			(double scale);
+
+	const RandomKey&	key					() const {return mKeyFields;}
+
+  private:
+	static unsigned long long mix			(unsigned long long z);
+
+	RandomKey			mKeyFields;
+	unsigned long long	mKey;				// Hash of the key fields
+	unsigned long long	mCounter;
+};
+
+/*******************************************************************************
+ * Sets the random number stream of the calling thread for the
+ * lifetime of the context object. The contexts can be nested; the
+ * previous stream is restored when the context is destroyed.
+ *
+ * The random functions below draw from the stream of the current
+ * context, or from the global generator of MagiC if the thread has no
+ * context or the purpose of the key is NONE.
+ ******************************************************************************/
+class RandomContext {
+  public:
+						RandomContext		(const RandomKey& key);
+						~RandomContext		();
+
+	/** Returns the stream of the calling thread, or NULL if none. */
+	static RandomStream* current			();
+
+  private:
+	RandomStream		mStream;
+	RandomStream*		mpPrevious;
+
+						RandomContext		(const RandomContext& other) : mStream (other.mStream) {FORBIDDEN}
+};
+
+/** Uniform random number in [0,1) from the stream of the thread, like frnd. */
+double	streamFrnd		();
+
+/** Uniform random integer in [0,n) from the stream of the thread, like rnd. */
+int		streamRnd		(int n);
+
+/** Normal random number from the stream of the thread, like gaussrnd. */
+double	streamGaussrnd	(double scale);
+
+/*******************************************************************************
+ * Initializer that sets normally distributed weights and biases from
+ * the random stream of the thread, for reproducible initialization
+ * in parallel evaluation.
+ ******************************************************************************/
+class StreamInitializer : public NetInitializer {
+  public:
+						StreamInitializer	(double scale=1.0) : mScale (scale) {}
+
+	/** Implementation for @ref NetInitializer. */
+	virtual void		initialize			(ANNetwork& net) const;
+
+  private:
+	double				mScale;
+};
+
+#endif
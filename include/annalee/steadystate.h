@@ -0,0 +1,146 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ANNALEE_STEADYSTATE_H__
+#define __ANNALEE_STEADYSTATE_H__
+
+#include <pthread.h>
+#include <magic/mmap.h>
+#include "checkpoint.h"
+
+class Individual;
+class OStream;
+class LearningEAEnv;
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//       ___                      |           ___                           //
+//      (   \ |    ___   ___      |          (   \ |    ___  |    ___       //
+//       \__  -+- /   )  ___|  ---| |   |     \__  -+-  ___| -+- /   )      //
+//          ) |   |---  (   | (   | |   |        ) |   (   | |   |---       //
+//      \___)  \   \__   \__|  ---|  \__|    \___)  \   \__|  \   \__       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Steady-state evolution in a @ref LearningEAEnv.
+ *
+ * There are no generation barriers. Several evaluator threads each
+ * breed one offspring, evaluate it and insert it into the
+ * population, and then immediately breed the next one. The
+ * training times of the individuals vary greatly with the network
+ * size and the early termination, so with barriers the processors
+ * would wait for the slowest individual of every generation.
+ *
+ * An offspring is produced by tournament selection, NEAT crossover
+ * when both parents have a NEAT brainplan, and point mutation. It
+ * replaces the worst member of the population, unless it is worse
+ * than all of them. The environment reports the champion after every
+ * population-size insertions, so the report, picture and checkpoint
+ * intervals of the environment count such pseudo-generations. The
+ * reports are made outside the population lock, so the other
+ * evaluators continue meanwhile.
+ *
+ * When the environment evaluates in worker processes, there should
+ * be one evaluator thread for each worker.
+ *
+ * The population is saved in the checkpoints of the environment. If
+ * the environment was restored from a checkpoint, the evolution
+ * continues from the population stored in it, provided that the
+ * encoding can be packed; see @ref ANNEncoding::pack.
+ ******************************************************************************/
+class SteadyStateEA : public CheckpointSource {
+  public:
+
+	/** Standard constructor.
+	 *
+	 * @param env The environment that evaluates the individuals.
+	 * @param params Dynamic parameter @ref String @ref Map.
+	 * @param params["SteadyStateEA.size"] Population size. [Default=50]
+	 * @param params["SteadyStateEA.maxEvaluations"] Number of evaluations to run. [Default=100 times the population size]
+	 * @param params["SteadyStateEA.threads"] Number of evaluator threads, 0 for the number of worker processes of the environment or, without workers, the number of processors. [Default=0]
+	 * @param params["SteadyStateEA.tournament"] Tournament size of the parent selection. [Default=3]
+	 * @param params["SteadyStateEA.crossover"] Probability of crossover of NEAT parents. [Default=0.5]
+	 * @param params["SteadyStateEA.mutationRate"] Point mutation rate. [Default=0.1]
+	 **/
+						SteadyStateEA		(LearningEAEnv& env, const StringMap& params);
+						~SteadyStateEA		();
+
+	/** Runs the evolution until the evaluation budget is spent.
+	 *
+	 * @param log Log stream for the reports of the environment.
+	 * @param out Output stream for the reports of the environment.
+	 **/
+	void				evolve				(OStream& log, OStream& out);
+
+	/** Number of evaluations completed so far. */
+	int					evaluations			() const {return mEvaluated;}
+
+	/** Fitness of the best individual, smaller is better. */
+	double				bestFitness			() const;
+
+	/** Implementation for @ref CheckpointSource. Adds the
+	 *  population with its fitness values and the evaluation
+	 *  counter.
+	 **/
+	virtual void		addCheckpointSections	(CheckpointWriter& writer);
+
+  private:
+	/** An evaluated member of the population. */
+	struct Member {
+		Individual*	individual;
+		double		fitness;
+	};
+
+	static void*		evaluatorThread		(void* self);
+	void				evaluator			();
+	Individual*			breed				();
+	int					tournament			() const;
+	bool				insert				(Individual* ind, double fitness);
+	void				report				();
+	void				restore				(const Checkpoint& checkpoint);
+
+	LearningEAEnv&		mrEnv;
+	Member*				mpMembers;			// Evaluated population
+	int					mMembers;
+	int					mSize;				// Target population size
+	int					mMaxEvaluations;
+	int					mThreads;
+	int					mTournament;
+	double				mCrossover;
+	double				mMutationRate;
+	int					mDispatched;		// Offspring sent to evaluation
+	int					mEvaluated;			// Offspring inserted
+	int					mBest;				// Index of the best member
+	String				mError;				// First evaluation error
+	OStream*			mpLog;
+	OStream*			mpOut;
+	Individual*			mpReported;			// Champion set to the environment, or NULL
+	bool				mReportedReplaced;	// It left the population and is owned here
+	pthread_mutex_t		mMutex;				// Guards the population and the counters
+	pthread_mutex_t		mReportMutex;		// Serializes the reports
+
+						SteadyStateEA		(const SteadyStateEA& other) : mrEnv (other.mrEnv) {FORBIDDEN}
+};
+
+#endif
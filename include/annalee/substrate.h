@@ -0,0 +1,114 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef __ANNALEE_SUBSTRATE_H__
+#define __ANNALEE_SUBSTRATE_H__
+
+#include "neat.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//              ___        |                                                //
+//             (   \       |           |        ___  |    ___               //
+//              \__  |   | |---   ___  -+- |/\  ___| -+- /   )              //
+//                 ) |   | |   ) (     |   |   (   | |   |---               //
+//             \___)  \__! |__/   ---)  \  |    \__|  \   \__               //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Substrate encoding for large neural networks.
+ *
+ * The genome is a NEAT genome of a small compositional network
+ * (CPPN), which is queried with the coordinates of two neurons of a
+ * fixed substrate to get the weight of the connection between them,
+ * in the spirit of HyperNEAT:
+ * - Kenneth O. Stanley, David B. D'Ambrosio and Jason Gauci, A
+ *   Hypercube-Based Encoding for Evolving Large-Scale Neural
+ *   Networks, Artificial Life 15(2), 2009.
+ *
+ * The substrate is laid out in a 2-dimensional cell space like that
+ * of @ref NolfiNet: the inputs are on the left edge, the hidden
+ * neurons in columns in the middle and the outputs on the right
+ * edge. In the layered topology each hidden column is connected from
+ * the previous column (or the inputs) and the outputs from the last
+ * hidden column. In the full topology every neuron can be connected
+ * to every other non-input neuron, including the lateral and
+ * backward connections, which are relaxed like the recurrent
+ * connections of NEAT.
+ *
+ * The CPPN is queried for all the candidate connections of the
+ * substrate in a single batched pass, and the connections whose
+ * weight magnitude exceeds the threshold are written directly to a
+ * compressed-row @ref NEATNetwork. It is placed in the host as
+ * "neatbrain", and its forward connections as the "brainplan"
+ * network. The CPPN is always feed-forward.
+ ******************************************************************************/
+class SubstrateEncoding : public NEATEncoding {
+	decl_dynamic (SubstrateEncoding);
+  public:
+						SubstrateEncoding	() {FORBIDDEN}
+						SubstrateEncoding	(const GeneticID& name,
+											 const StringMap& params);
+						SubstrateEncoding	(const SubstrateEncoding& other);
+
+	// Implementations
+
+	/** Implementation for @ref Genstruct. */
+	virtual Genstruct*	replicate			() const;
+
+	/** Implementation for @ref Genstruct. */
+	virtual void		copy				(const Genstruct& other);
+
+	/** Implementation for @ref Genstruct. */
+	virtual bool		execute				(const GeneticMsg& msg) const;
+
+	/** Implementation for @ref Genstruct. */
+	virtual void		addPrivateGenes		(Gentainer& g, const StringMap& params);
+
+	/** Implementation for @ref Object. */
+	virtual void		check				() const;
+
+	/** Decodes the substrate network.
+	 *
+	 * @return The compiled substrate, owned by the caller.
+	 **/
+	NEATNetwork*		decode				() const;
+
+	/** Number of inputs of the CPPN: the coordinates of the source
+	 *  and target neurons and a bias.
+	 **/
+	enum {CPPN_INPUTS=5};
+
+  protected:
+	int					mSubInputs;			// Inputs of the substrate
+	int					mSubOutputs;		// Outputs of the substrate
+	int					mColumns;			// Hidden columns of the substrate
+	int					mRows;				// Hidden neurons per column
+	double				mThreshold;			// Minimum CPPN output magnitude for a connection
+	double				mMaxWeight;			// Weight for a CPPN output of magnitude 1
+	bool				mFullTopology;		// Connect all pairs instead of adjacent columns
+};
+
+#endif
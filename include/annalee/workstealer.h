@@ -0,0 +1,124 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef __ANNALEE_WORKSTEALER_H__
+#define __ANNALEE_WORKSTEALER_H__
+
+#include <pthread.h>
+#include <magic/mmap.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//      |   |          |        ___                  | o                    //
+//      |   |          |       (   \ |    ___   ___  |     _                //
+//      | | |  __  |/\ | /      \__  -+- /   )  ___| | |  |/ \   ___        //
+//      |\ /| /  \ |   |<          ) |   |---  (   | | |  |   | (   \       //
+//      |   | \__/ |   | \     \___)  \   \__   \__| | |  |   |  ---/       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * A set of independent tasks for a @ref WorkStealer.
+ ******************************************************************************/
+class WorkTasks {
+  public:
+	virtual				~WorkTasks			() {}
+
+	/** Cheap estimate of the relative cost of a task, such as the
+	 *  number of connections of the network to be trained.
+	 **/
+	virtual double		cost				(int task) const = 0;
+
+	/** Runs a task. Called from several threads at once. */
+	virtual void		run					(int task) = 0;
+};
+
+/*******************************************************************************
+ * Runs tasks of very different costs in parallel threads.
+ *
+ * The tasks are sorted by their estimated cost and dealt largest
+ * first to the deques of the threads, each task to the thread with
+ * the least total cost so far. Each thread runs its own tasks from
+ * the large end of its deque. A thread that runs out of tasks steals
+ * from the small end of the deque with the most remaining cost, so
+ * the stragglers at the end are small tasks that fill the idle
+ * threads, whatever the errors of the estimates were.
+ *
+ * The calling thread works as one of the threads.
+ ******************************************************************************/
+class WorkStealer {
+  public:
+
+	/** @param threads Number of threads, 0 for the number of processors. */
+						WorkStealer			(int threads=0);
+						~WorkStealer		();
+
+	/** Runs the tasks 0...n-1 and returns when all of them are done.
+	 *
+	 * If a task throws, the tasks that have not yet started are
+	 * skipped and the first error is thrown after the running tasks
+	 * have finished.
+	 **/
+	void				run					(WorkTasks& tasks, int n);
+
+	/** Number of threads. */
+	int					threads				() const {return mThreads;}
+
+	/** Number of tasks stolen in the latest run. */
+	int					steals				() const {return mSteals;}
+
+  private:
+	/** Tasks of a thread, in decreasing order of cost. */
+	struct Deque {
+		int*			tasks;
+		double*			costs;
+		int				head, tail;
+		double			remaining;		// Total cost of the tasks in the deque
+		pthread_mutex_t	mutex;
+	};
+
+	/** Argument of a thread. */
+	struct Work {
+		WorkStealer*	self;
+		int				thread;
+	};
+
+	static void*		workerThread		(void* work);
+	void				work				(int thread);
+	bool				pop					(int thread, int& task);
+	bool				steal				(int& task);
+	void				fail				(const String& error);
+
+	int					mThreads;
+	Deque*				mpDeques;		// Deques of the latest run
+	int					mDeques;
+	WorkTasks*			mpTasks;
+	int					mSteals;
+	String				mError;			// First error of the latest run
+	bool				mFailed;
+	pthread_mutex_t		mMutex;			// Guards the error and the steal count
+
+						WorkStealer			(const WorkStealer& other) {FORBIDDEN}
+};
+
+#endif
@@ -43,17 +43,21 @@ include $(SRCDIR)/build/magicdef.mk
 # Source files
 ################################################################################
 
-sources =	anngenes.cc cangelosi.cc \
-		kitano.cc layered.cc \
-		learningenv.cc miller.cc nolfi.cc nolfinet.cc puredirect.cc \
-		neat.cc
+sources =	anngenes.cc arena.cc asyncwriter.cc brainfile.cc cangelosi.cc checkpoint.cc epsstream.cc evalfarm.cc \
+		generational.cc kitano.cc layered.cc \
+		learningenv.cc miller.cc nolfi.cc nolfinet.cc puredirect.cc randomstream.cc \
+		neat.cc neatgenome.cc neatnetwork.cc neatspecies.cc \
+		steadystate.cc substrate.cc workstealer.cc
 
-headers =	anngenes.h cangelosi.h cangelosinet.h \
-		kitano.h layered.h learningenv.h miller.h nolfi.h nolfinet.h \
-		neat.h
+headers =	anngenes.h arena.h asyncwriter.h brainfile.h cangelosi.h cangelosinet.h checkpoint.h epsstream.h evalfarm.h \
+		generational.h kitano.h layered.h learningenv.h miller.h nolfi.h nolfinet.h randomstream.h \
+		neat.h neatgenome.h neatnetwork.h neatspecies.h \
+		steadystate.h substrate.h workstealer.h
 
 headersubdir =	annalee
 
+EXTRA_LIBS = -lpthread
+
 ################################################################################
 # Recursively compile some subprojects
 ################################################################################
@@ -43,10 +43,10 @@ include $(SRCDIR)/build/magicdef.mk
 # Source files for libmagic.a
 ################################################################################
 sources = anngrammar.cc neuralenc.cc matrixenc.cc matrixenv.cc symbolenc.cc \
-	  binsymenc.cc fastnetwork.cc
+	  binsymenc.cc fastnetwork.cc tiledeval.cc
 
 headers = neuralenc.h matrixenc.h binsymenc.h matrixenv.h symbolenc.h \
-	  fastnetwork.h
+	  fastnetwork.h tiledeval.h
 
 libdeps = inanna nhp magic app
 
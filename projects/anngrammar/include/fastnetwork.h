@@ -1,6 +1,24 @@
 #ifndef __FASTNETWORK_H__
 #define __FASTNETWORK_H__
 
+/** Small fully connected four-layer network used by the neural matrix
+ * grammar.
+ *
+ * The activations and weights are single-precision floats in 32-byte
+ * aligned arrays. The weights of a layer are stored source-major,
+ * with each row padded to a multiple of 8 target units, so that the
+ * update computes 8 units at a time with AVX2 when the compiler
+ * targets it, and with plain loops otherwise. The units use a fast
+ * rational approximation of the logistic sigmoid.
+ *
+ * The weights are addressed with logical indices: for each layer, for
+ * each target unit, the weights from the units of the previous layer
+ * followed by the bias.
+ *
+ * Many input vectors can be evaluated at once with updateBatch(),
+ * which computes each layer for the whole batch as one matrix
+ * product, reusing every loaded weight vector for several samples.
+ **/
 class FastNetwork {
   public:
 					FastNetwork		(int inputs, int h1, int h2, int outputs);
@@ -8,21 +26,149 @@ class FastNetwork {
 					~FastNetwork	();
 
 	void			setInputs		(const double* pInputs);
-	double*			getInputs		() {return mpActivation;}
-	double*			getWeights		() {return mpWeights;}
-	const double*	getOutputs		() const {return mpActivation + mUnits -mLayerSizes[3];}
+	void			setInputs		(const float* pInputs);
+	float*			getInputs		() {return mpActivation;}
+	const float*	getOutputs		() const {return mpActivation + mLayerStart[3];}
+	void			setWeight		(int i, float w) {mpWeights[weightOffset (i)] = w;}
+	float			weight			(int i) const {return mpWeights[weightOffset (i)];}
+
+	class WeightArray;
+
+	/** The weights with the interface of the former double array,
+	 *  getWeights()[i], by logical index. For the callers written
+	 *  against the old interface; new code should use setWeight()
+	 *  and weight().
+	 **/
+	WeightArray		getWeights		();
 	inline int		size			() const {return mUnits;}
 	inline int		weights			() const {return mWeights;}
 	inline int		layerSize		(int i) const {return mLayerSizes[i];}
 	void			update			();
 
+	/** Evaluates the network for n input vectors.
+	 *
+	 * @param pInputs n input vectors of layerSize(0) values, one
+	 *        after another.
+	 * @param pOutputs Array where the n output vectors of
+	 *        layerSize(3) values are stored one after another.
+	 **/
+	void			updateBatch		(const float* pInputs, int n, float* pOutputs);
+
+	/** The activation function: a rational approximation of the
+	 *  logistic sigmoid with the same value and slope at zero and the
+	 *  same limits, but no exp().
+	 **/
+	static inline float	sigmoid		(float x) {return 0.5f + 0.25f*x/(1.0f + 0.5f*(x<0? -x : x));}
+
+	/** Rounds a number of units up to a whole number of 8-float vectors. */
+	static inline int	padded		(int units) {return (units+7) & ~7;}
+
+	/** Signature of the evaluation function of a fixed-size variant. */
+	typedef void	(*Kernel)		(const float* pWeights, const float* pInputs, int n,
+									 float* pOutputs);
+
+	/** Returns the evaluation function of the fixed-size variant for
+	 *  the given layer sizes, or NULL if there is none.
+	 **/
+	static Kernel	fixedKernel		(int inputs, int h1, int h2, int outputs);
+
   private:
+	int				weightOffset	(int i) const;
+	void			updateLayer		(int l, const float* in, int inStride,
+									 float* out, int outStride, int n) const;
+	void			allocate		();
+	void			reserveBatch	(int n);
+
 	int mLayerSizes[4];
+	int mPadded[4];			// Layer sizes rounded up to a multiple of 8
+	int mLayerStart[4];		// Offset of each layer in mpActivation
+	int mWeightStart[4];	// Offset of the weights into each layer in mpWeights
 	int mUnits;
-	int mWeights;
-	
-	double* mpActivation;
-	double* mpWeights;
+	int mWeights;			// Logical number of weights
+	int mActivations;		// Allocated activations
+	int mStorage;			// Allocated weights
+
+	float* mpActivation;
+	float* mpWeights;
+	float* mpBatch;			// Two layers of activations for a batch
+	int mBatchCapacity;
+	Kernel mpKernel;		// Fixed-size variant, or NULL
+};
+
+/** Reference to a weight of a @ref FastNetwork by logical index,
+ *  converting to and from double.
+ **/
+class FastNetworkWeight {
+  public:
+						FastNetworkWeight	(FastNetwork& net, int i) : mrNet (net), mIndex (i) {}
+
+						operator double		() const {return mrNet.weight (mIndex);}
+	FastNetworkWeight&	operator=			(double w) {mrNet.setWeight (mIndex, float(w)); return *this;}
+	FastNetworkWeight&	operator=			(const FastNetworkWeight& other) {return *this = double (other);}
+	FastNetworkWeight&	operator+=			(double w) {return *this = double (*this) + w;}
+
+  private:
+	FastNetwork&		mrNet;
+	int					mIndex;
+};
+
+/** The weights of a @ref FastNetwork as an array, see @ref
+ *  FastNetwork::getWeights.
+ **/
+class FastNetwork::WeightArray {
+  public:
+						WeightArray			(FastNetwork& net) : mrNet (net) {}
+
+	FastNetworkWeight	operator[]			(int i) const {return FastNetworkWeight (mrNet, i);}
+
+  private:
+	FastNetwork&		mrNet;
+};
+
+inline FastNetwork::WeightArray FastNetwork::getWeights () {return WeightArray (*this);}
+
+/** FastNetwork with the layer sizes fixed at compile time.
+ *
+ * Works on the weight array of a @ref FastNetwork of the same shape.
+ * As all the loop bounds and strides are constants, the compiler can
+ * unroll the loops completely and keep the activations in registers,
+ * which matters for the tiny networks of the matrix grammars.
+ **/
+template <int I, int H1, int H2, int O>
+class FixedFastNetwork {
+  public:
+	/** Evaluates n dense input vectors into n dense output vectors,
+	 *  like @ref FastNetwork::updateBatch.
+	 **/
+	static void		update			(const float* pWeights, const float* pInputs, int n,
+									 float* pOutputs) {
+		const float* w1 = pWeights;
+		const float* w2 = w1 + (I+1)*Padded<H1>::value;
+		const float* w3 = w2 + (H1+1)*Padded<H2>::value;
+		for (int b=0; b<n; b++) {
+			float h1[H1], h2[H2];
+			layer<I,H1> (w1, pInputs + b*I, h1);
+			layer<H1,H2> (w2, h1, h2);
+			layer<H2,O> (w3, h2, pOutputs + b*O);
+		}
+	}
+
+  private:
+	template <int N>
+	struct Padded {enum {value = (N+7) & ~7};};
+
+	template <int S, int T>
+	static inline void	layer		(const float* w, const float* in, float* out) {
+		const float* bias = w + S*Padded<T>::value;
+		float sum[T];
+		for (int j=0; j<T; j++)
+			sum[j] = bias[j];
+		for (int k=0; k<S; k++)
+			for (int j=0; j<T; j++)
+				sum[j] += w[k*Padded<T>::value+j] * in[k];
+		for (int j=0; j<T; j++)
+			out[j] = FastNetwork::sigmoid (sum[j]);
+	}
 };
 
 #endif
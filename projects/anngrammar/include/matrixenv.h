@@ -16,11 +16,18 @@ class MatrixEnv : public EAEnvironment {
 	
 	virtual void		addFeaturesTo	(Genome& genome) const;
 	virtual void		cycle_report	(OStream& log, OStream& out);
+	// TODO: Multiresolution fitness: score the individuals first at a
+	// low rewrite depth against a mip-pyramid of mMatrix, and decode
+	// to full depth only those whose coarse error passes a quantile
+	// cut of the recent ones.
 	virtual double		evaluateg		(const Individual& genome);
 	TextOStream&		operator>>		(TextOStream& out) const;
 	void				check			() const;
 
   private:
+	// TODO: Load raw and binary PGM/PPM targets through a memory-mapped
+	// cache file next to the image, instead of decoding a GIF at every
+	// startup, so that worker processes share the pages.
 	Matrix				mMatrix;
 	int					mPowerOf2;
 	const StringMap*	mrpParamMap;
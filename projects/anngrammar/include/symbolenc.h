@@ -16,6 +16,10 @@ class SymbolMatrixEnc : public MatrixEnc {
 	void				check				() const;
 
   protected:
+	// TODO: Memoize the expansion: build the block of each distinct
+	// (symbol, depth) pair once and copy it to its occurrences, so
+	// that BinSymMatrixEnc also gets deeper grammars without the
+	// exponential decoding cost.
 	PackTable<uchar>*	decodeMatrix		(const PackTable<uchar>& matrix,
 											 const PackTable<uchar>& rules, int l) const;
 };
@@ -0,0 +1,102 @@
+#ifndef __TILEDEVAL_H__
+#define __TILEDEVAL_H__
+
+#include <pthread.h>
+#include <magic/mclass.h>
+
+/** Source of the square tiles of an image to be compared. The tiles
+ *  are requested from several threads at once.
+ **/
+class TileDecoder {
+  public:
+	virtual			~TileDecoder	() {}
+
+	/** Decodes the tile at the given tile row and column into pOut,
+	 *  a tileSize*tileSize array with rows of tileSize values.
+	 **/
+	virtual void	decodeTile		(int row, int col, int tileSize, float* pOut) const = 0;
+};
+
+/** Tile source for an image that has already been decoded whole. The
+ *  tiles are only copied, so the decoding itself is not parallel.
+ **/
+class ImageTileDecoder : public TileDecoder {
+  public:
+					ImageTileDecoder	(const float* pImage, int size) : mpImage (pImage), mSize (size) {}
+
+	void			decodeTile		(int row, int col, int tileSize, float* pOut) const;
+
+  private:
+	const float*	mpImage;
+	int				mSize;
+};
+
+/** Compares images against a target image tile by tile in parallel
+ *  threads.
+ *
+ * The threads take tiles from a shared counter, get them from a @ref
+ * TileDecoder and compute the squared error against the target with
+ * a vectorized reduction. The errors of the tiles are summed in tile
+ * order, so the result does not depend on the number of threads.
+ *
+ * The threads are started with the evaluator and wait for the next
+ * image between the calls. The calling thread works as one of them.
+ * Only one image can be evaluated at a time.
+ *
+ * Nothing in this tree calls the evaluator yet: MatrixEnv::evaluateg
+ * is in matrixenv.cc, which is not included here.
+ **/
+class TiledEvaluator {
+  public:
+	/**
+	 * @param pTarget The target image, size*size values. Not copied.
+	 * @param size Size of the image, a power of two.
+	 * @param tileSize Size of the tiles, a power of two. Clamped to the image size.
+	 * @param threads Number of threads, 0 for the number of processors.
+	 **/
+					TiledEvaluator	(const float* pTarget, int size, int tileSize=64,
+									 int threads=0);
+					~TiledEvaluator	();
+
+	/** Returns the sum of squared errors of the image. An error
+	 *  thrown by the decoder in any thread is thrown here.
+	 **/
+	double			sumSquaredError	(const TileDecoder& decoder);
+
+	/** Returns the sum of squared differences of two arrays. */
+	static double	squaredError	(const float* pA, const float* pB, int n);
+
+	int				tiles			() const {return mTiles*mTiles;}
+
+  private:
+	struct Work {
+		TiledEvaluator*		self;
+		String				error;		// Error raised in the thread, if any
+	};
+
+	static void*	worker			(void* work);
+	void			evaluateTiles	(const TileDecoder& decoder);
+
+	const float*	mpTarget;
+	int				mSize;
+	int				mTileSize;
+	int				mTiles;			// Tiles per side
+	int				mThreads;
+	double*			mpErrors;		// Squared error of each tile
+	volatile int	mNext;			// Next tile to evaluate
+
+	pthread_t*		mpIds;
+	Work*			mpWork;
+	int				mStarted;		// Threads running besides the caller
+	const TileDecoder* mpDecoder;	// Decoder of the current image
+	int				mRound;			// Number of images started
+	int				mActive;		// Threads still working on the current image
+	bool			mQuit;
+	pthread_mutex_t	mMutex;
+	pthread_cond_t	mStart;			// Signaled when an image is started
+	pthread_cond_t	mDone;			// Signaled when the last thread is done
+
+					TiledEvaluator	(const TiledEvaluator& other) {FORBIDDEN}
+};
+
+#endif
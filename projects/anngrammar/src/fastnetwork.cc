@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <magic/mclass.h>
+
+#include "fastnetwork.h"
+
+/** Layer sizes of the instantiated fixed-size variants. The matrix
+ *  grammars use four context inputs and four outputs. With AVX2, the
+ *  blocked vector kernel beats the unrolled loops once the hidden
+ *  layers fill a vector, so only the smallest shapes are used there.
+ **/
+static const struct {
+	int					sizes[4];
+	FastNetwork::Kernel	kernel;
+} fixedShapes[] = {
+	{{4, 4, 4, 4},		FixedFastNetwork<4, 4, 4, 4>::update},
+	{{4, 4, 4, 1},		FixedFastNetwork<4, 4, 4, 1>::update},
+#ifndef __AVX2__
+	{{4, 8, 8, 4},		FixedFastNetwork<4, 8, 8, 4>::update},
+	{{4, 8, 8, 1},		FixedFastNetwork<4, 8, 8, 1>::update},
+	{{4, 16, 16, 4},	FixedFastNetwork<4, 16, 16, 4>::update},
+#endif
+};
+
+FastNetwork::Kernel FastNetwork::fixedKernel (int inputs, int h1, int h2, int outputs)
+{
+	for (unsigned int i=0; i<sizeof(fixedShapes)/sizeof(fixedShapes[0]); i++)
+		if (fixedShapes[i].sizes[0] == inputs && fixedShapes[i].sizes[1] == h1
+			&& fixedShapes[i].sizes[2] == h2 && fixedShapes[i].sizes[3] == outputs)
+			return fixedShapes[i].kernel;
+	return NULL;
+}
+
+FastNetwork::FastNetwork (int inputs, int h1, int h2, int outputs)
+{
+	mLayerSizes[0] = inputs;
+	mLayerSizes[1] = h1;
+	mLayerSizes[2] = h2;
+	mLayerSizes[3] = outputs;
+	allocate ();
+}
+
+FastNetwork::FastNetwork (const FastNetwork& other)
+{
+	memcpy (mLayerSizes, other.mLayerSizes, sizeof(mLayerSizes));
+	allocate ();
+	memcpy (mpActivation, other.mpActivation, mActivations*sizeof(float));
+	memcpy (mpWeights, other.mpWeights, mStorage*sizeof(float));
+}
+
+FastNetwork::~FastNetwork ()
+{
+	free (mpActivation);
+	free (mpWeights);
+	free (mpBatch);
+}
+
+void FastNetwork::allocate ()
+{
+	mpBatch = NULL;
+	mBatchCapacity = 0;
+	mpKernel = fixedKernel (mLayerSizes[0], mLayerSizes[1], mLayerSizes[2], mLayerSizes[3]);
+	mUnits = mWeights = mActivations = mStorage = 0;
+	for (int l=0; l<4; l++) {
+		ASSERT (mLayerSizes[l] > 0);
+		mPadded[l] = padded (mLayerSizes[l]);
+		mLayerStart[l] = mActivations;
+		mActivations += mPadded[l];
+		mUnits += mLayerSizes[l];
+	}
+	mWeightStart[0] = 0;
+	for (int l=1; l<4; l++) {
+		// One row for each source unit and one for the bias
+		mWeightStart[l] = mStorage;
+		mStorage += (mLayerSizes[l-1]+1) * mPadded[l];
+		mWeights += (mLayerSizes[l-1]+1) * mLayerSizes[l];
+	}
+
+	if (posix_memalign ((void**) &mpActivation, 32, mActivations*sizeof(float)) != 0
+		|| posix_memalign ((void**) &mpWeights, 32, mStorage*sizeof(float)) != 0)
+		throw generic_exception ("FastNetwork: out of memory");
+	memset (mpActivation, 0, mActivations*sizeof(float));
+	memset (mpWeights, 0, mStorage*sizeof(float));
+}
+
+int FastNetwork::weightOffset (int i) const
+{
+	ASSERT (i>=0 && i<mWeights);
+	for (int l=1; l<4; l++) {
+		int rows = mLayerSizes[l-1]+1;
+		if (i < rows*mLayerSizes[l]) {
+			int target = i / rows;
+			int source = i % rows;
+			return mWeightStart[l] + source*mPadded[l] + target;
+		}
+		i -= rows*mLayerSizes[l];
+	}
+	return 0;
+}
+
+void FastNetwork::setInputs (const double* pInputs)
+{
+	for (int i=0; i<mLayerSizes[0]; i++)
+		mpActivation[i] = float(pInputs[i]);
+}
+
+void FastNetwork::setInputs (const float* pInputs)
+{
+	memcpy (mpActivation, pInputs, mLayerSizes[0]*sizeof(float));
+}
+
+void FastNetwork::update ()
+{
+	if (mpKernel) {
+		mpKernel (mpWeights, mpActivation, 1, mpActivation + mLayerStart[3]);
+		return;
+	}
+	for (int l=1; l<4; l++)
+		updateLayer (l, mpActivation + mLayerStart[l-1], mPadded[l-1],
+					 mpActivation + mLayerStart[l], mPadded[l], 1);
+}
+
+void FastNetwork::updateBatch (const float* pInputs, int n, float* pOutputs)
+{
+	if (mpKernel) {
+		mpKernel (mpWeights, pInputs, n, pOutputs);
+		return;
+	}
+
+	reserveBatch (n);
+
+	int widest = 0;
+	for (int l=1; l<4; l++)
+		if (mPadded[l] > widest)
+			widest = mPadded[l];
+	float* buffer[2] = {mpBatch, mpBatch + mBatchCapacity*widest};
+
+	// The input layer is read directly from the dense input vectors
+	const float* in = pInputs;
+	int inStride = mLayerSizes[0];
+	for (int l=1; l<4; l++) {
+		float* out = buffer[l&1];
+		updateLayer (l, in, inStride, out, mPadded[l], n);
+		in = out;
+		inStride = mPadded[l];
+	}
+
+	for (int b=0; b<n; b++)
+		memcpy (pOutputs + b*mLayerSizes[3], in + b*inStride, mLayerSizes[3]*sizeof(float));
+}
+
+void FastNetwork::reserveBatch (int n)
+{
+	if (n <= mBatchCapacity)
+		return;
+
+	int widest = 0;
+	for (int l=1; l<4; l++)
+		if (mPadded[l] > widest)
+			widest = mPadded[l];
+
+	free (mpBatch);
+	mpBatch = NULL;
+	if (posix_memalign ((void**) &mpBatch, 32, 2*n*widest*sizeof(float)) != 0)
+		throw generic_exception ("FastNetwork: out of memory");
+	mBatchCapacity = n;
+}
+
+#ifdef __AVX2__
+static inline __m256 madd (__m256 a, __m256 b, __m256 c)
+{
+#ifdef __FMA__
+	return _mm256_fmadd_ps (a, b, c);
+#else
+	return _mm256_add_ps (_mm256_mul_ps (a, b), c);
+#endif
+}
+
+/** FastNetwork::sigmoid for 8 values: 0.5+0.25x/(1+0.5|x|), computed
+ *  as 0.5+0.5y/(1+|y|) with y=0.5x.
+ **/
+static inline __m256 fastSigmoid (__m256 x)
+{
+	const __m256 half = _mm256_set1_ps (0.5f);
+	const __m256 one = _mm256_set1_ps (1.0f);
+	const __m256 y = _mm256_mul_ps (half, x);
+	const __m256 abs = _mm256_andnot_ps (_mm256_set1_ps (-0.0f), y);
+	return madd (half, _mm256_div_ps (y, _mm256_add_ps (one, abs)), half);
+}
+#endif
+
+/** Computes the activations of a layer from the previous layer for n
+ *  samples, whose activations are in rows of the given strides. The
+ *  padding units get the activation of a zero input; they are never
+ *  read by the next layer.
+ *
+ *  With AVX2, four samples are computed at a time, so that every
+ *  weight vector loaded is used for four multiply-adds.
+ **/
+void FastNetwork::updateLayer (int l, const float* in, int inStride,
+							   float* out, int outStride, int n) const
+{
+	const int sources = mLayerSizes[l-1];
+	const int width = mPadded[l];
+	const float* w = mpWeights + mWeightStart[l];
+	const float* bias = w + sources*width;
+
+	int b = 0;
+#ifdef __AVX2__
+	for (; b+4<=n; b+=4) {
+		const float* in0 = in + b*inStride;
+		const float* in1 = in0 + inStride;
+		const float* in2 = in1 + inStride;
+		const float* in3 = in2 + inStride;
+		float* out0 = out + b*outStride;
+		for (int j=0; j<width; j+=8) {
+			__m256 sum0 = _mm256_load_ps (bias+j);
+			__m256 sum1 = sum0, sum2 = sum0, sum3 = sum0;
+			for (int k=0; k<sources; k++) {
+				const __m256 wv = _mm256_load_ps (w+k*width+j);
+				sum0 = madd (wv, _mm256_set1_ps (in0[k]), sum0);
+				sum1 = madd (wv, _mm256_set1_ps (in1[k]), sum1);
+				sum2 = madd (wv, _mm256_set1_ps (in2[k]), sum2);
+				sum3 = madd (wv, _mm256_set1_ps (in3[k]), sum3);
+			}
+			_mm256_storeu_ps (out0+j, fastSigmoid (sum0));
+			_mm256_storeu_ps (out0+outStride+j, fastSigmoid (sum1));
+			_mm256_storeu_ps (out0+2*outStride+j, fastSigmoid (sum2));
+			_mm256_storeu_ps (out0+3*outStride+j, fastSigmoid (sum3));
+		}
+	}
+	for (; b<n; b++) {
+		const float* src = in + b*inStride;
+		float* dst = out + b*outStride;
+		for (int j=0; j<width; j+=8) {
+			__m256 sum = _mm256_load_ps (bias+j);
+			for (int k=0; k<sources; k++)
+				sum = madd (_mm256_load_ps (w+k*width+j), _mm256_set1_ps (src[k]), sum);
+			_mm256_storeu_ps (dst+j, fastSigmoid (sum));
+		}
+	}
+#else
+	for (; b<n; b++) {
+		const float* src = in + b*inStride;
+		float* dst = out + b*outStride;
+		for (int j=0; j<width; j++)
+			dst[j] = bias[j];
+		for (int k=0; k<sources; k++) {
+			const float a = src[k];
+			const float* row = w + k*width;
+			for (int j=0; j<width; j++)
+				dst[j] += row[j]*a;
+		}
+		for (int j=0; j<width; j++)
+			dst[j] = sigmoid (dst[j]);
+	}
+#endif
+}
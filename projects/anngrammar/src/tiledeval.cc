@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <magic/mclass.h>
+
+#include "tiledeval.h"
+
+void ImageTileDecoder::decodeTile (int row, int col, int tileSize, float* pOut) const
+{
+	const float* src = mpImage + row*tileSize*mSize + col*tileSize;
+	for (int r=0; r<tileSize; r++)
+		memcpy (pOut + r*tileSize, src + r*mSize, tileSize*sizeof(float));
+}
+
+TiledEvaluator::TiledEvaluator (const float* pTarget, int size, int tileSize, int threads)
+		: mpTarget (pTarget),
+		  mSize (size),
+		  mTileSize ((tileSize < size)? tileSize : size),
+		  mThreads (threads),
+		  mpIds (NULL),
+		  mpWork (NULL),
+		  mStarted (0),
+		  mpDecoder (NULL),
+		  mRound (0),
+		  mActive (0),
+		  mQuit (false)
+{
+	ASSERT (mSize>0 && (mSize & (mSize-1)) == 0);
+	ASSERT (mTileSize>0 && (mTileSize & (mTileSize-1)) == 0);
+	mTiles = mSize/mTileSize;
+	if (mThreads <= 0)
+		mThreads = int (sysconf (_SC_NPROCESSORS_ONLN));
+	if (mThreads <= 0)
+		mThreads = 1;
+	if (mThreads > mTiles*mTiles)
+		mThreads = mTiles*mTiles;
+	mpErrors = new double [mTiles*mTiles];
+
+	pthread_mutex_init (&mMutex, NULL);
+	pthread_cond_init (&mStart, NULL);
+	pthread_cond_init (&mDone, NULL);
+
+	// The calling thread works as thread 0. The tiles are taken from
+	// a shared counter, so the threads that could not be started are
+	// simply missing.
+	if (mThreads > 1) {
+		mpIds  = new pthread_t [mThreads-1];
+		mpWork = new Work [mThreads-1];
+		for (; mStarted<mThreads-1; mStarted++) {
+			mpWork[mStarted].self = this;
+			if (pthread_create (&mpIds[mStarted], NULL, worker, &mpWork[mStarted]) != 0)
+				break;
+		}
+	}
+}
+
+TiledEvaluator::~TiledEvaluator ()
+{
+	pthread_mutex_lock (&mMutex);
+	mQuit = true;
+	pthread_cond_broadcast (&mStart);
+	pthread_mutex_unlock (&mMutex);
+	for (int t=0; t<mStarted; t++)
+		pthread_join (mpIds[t], NULL);
+
+	delete [] mpIds;
+	delete [] mpWork;
+	delete [] mpErrors;
+	pthread_cond_destroy (&mStart);
+	pthread_cond_destroy (&mDone);
+	pthread_mutex_destroy (&mMutex);
+}
+
+double TiledEvaluator::sumSquaredError (const TileDecoder& decoder)
+{
+	mNext = 0;
+	if (mStarted == 0)
+		evaluateTiles (decoder);
+	else {
+		// Wake up the threads and work along with them
+		pthread_mutex_lock (&mMutex);
+		for (int t=0; t<mStarted; t++)
+			mpWork[t].error = "";
+		mpDecoder = &decoder;
+		mActive   = mStarted;
+		mRound++;
+		pthread_cond_broadcast (&mStart);
+		pthread_mutex_unlock (&mMutex);
+
+		String error;
+		try {
+			evaluateTiles (decoder);
+		} catch (generic_exception& e) {
+			error = e.what ();
+		}
+
+		pthread_mutex_lock (&mMutex);
+		while (mActive > 0)
+			pthread_cond_wait (&mDone, &mMutex);
+		mpDecoder = NULL;
+		pthread_mutex_unlock (&mMutex);
+
+		// An exception can't leave a thread, so the errors are
+		// raised here
+		for (int t=0; t<mStarted && error.isEmpty (); t++)
+			error = mpWork[t].error;
+		if (!error.isEmpty ())
+			throw generic_exception (error);
+	}
+
+	double sum = 0.0;
+	for (int i=0; i<mTiles*mTiles; i++)
+		sum += mpErrors[i];
+	return sum;
+}
+
+/*******************************************************************************
+ * The loop of a thread: evaluates its share of the tiles of each
+ * image when it is started, until the evaluator is destroyed.
+ ******************************************************************************/
+void* TiledEvaluator::worker (void* arg)
+{
+	Work* work = static_cast<Work*> (arg);
+	TiledEvaluator* self = work->self;
+	int round = 0;
+
+	pthread_mutex_lock (&self->mMutex);
+	while (true) {
+		while (!self->mQuit && self->mRound == round)
+			pthread_cond_wait (&self->mStart, &self->mMutex);
+		if (self->mQuit)
+			break;
+		round = self->mRound;
+		const TileDecoder* decoder = self->mpDecoder;
+		pthread_mutex_unlock (&self->mMutex);
+
+		try {
+			self->evaluateTiles (*decoder);
+		} catch (generic_exception& e) {
+			work->error = e.what ();
+		}
+
+		pthread_mutex_lock (&self->mMutex);
+		if (--self->mActive == 0)
+			pthread_cond_signal (&self->mDone);
+	}
+	pthread_mutex_unlock (&self->mMutex);
+	return NULL;
+}
+
+void TiledEvaluator::evaluateTiles (const TileDecoder& decoder)
+{
+	float* tile = NULL;
+	if (posix_memalign ((void**) &tile, 32, mTileSize*mTileSize*sizeof(float)) != 0)
+		throw generic_exception ("TiledEvaluator: out of memory");
+
+	for (int i = __sync_fetch_and_add (&mNext, 1); i < mTiles*mTiles;
+		 i = __sync_fetch_and_add (&mNext, 1)) {
+		int row = i / mTiles;
+		int col = i % mTiles;
+		try {
+			decoder.decodeTile (row, col, mTileSize, tile);
+		} catch (...) {
+			free (tile);
+			throw;
+		}
+
+		const float* target = mpTarget + row*mTileSize*mSize + col*mTileSize;
+		double error = 0.0;
+		for (int r=0; r<mTileSize; r++)
+			error += squaredError (tile + r*mTileSize, target + r*mSize, mTileSize);
+		mpErrors[i] = error;
+	}
+
+	free (tile);
+}
+
+double TiledEvaluator::squaredError (const float* pA, const float* pB, int n)
+{
+	int i = 0;
+	double sum = 0.0;
+#ifdef __AVX2__
+	__m256 acc0 = _mm256_setzero_ps ();
+	__m256 acc1 = _mm256_setzero_ps ();
+	for (; i+16<=n; i+=16) {
+		__m256 d0 = _mm256_sub_ps (_mm256_loadu_ps (pA+i), _mm256_loadu_ps (pB+i));
+		__m256 d1 = _mm256_sub_ps (_mm256_loadu_ps (pA+i+8), _mm256_loadu_ps (pB+i+8));
+#ifdef __FMA__
+		acc0 = _mm256_fmadd_ps (d0, d0, acc0);
+		acc1 = _mm256_fmadd_ps (d1, d1, acc1);
+#else
+		acc0 = _mm256_add_ps (acc0, _mm256_mul_ps (d0, d0));
+		acc1 = _mm256_add_ps (acc1, _mm256_mul_ps (d1, d1));
+#endif
+	}
+	float part[8];
+	_mm256_storeu_ps (part, _mm256_add_ps (acc0, acc1));
+	for (int k=0; k<8; k++)
+		sum += part[k];
+#endif
+	for (; i<n; i++) {
+		float d = pA[i]-pB[i];
+		sum += d*d;
+	}
+	return sum;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <magic/mclass.h>
+#include <inanna/annetwork.h>
+#include <inanna/annfilef.h>
+
+#include "annalee/brainfile.h"
+
+static bool endsWith (const char* str, const char* suffix)
+{
+	int n = strlen (str), m = strlen (suffix);
+	return n >= m && strcmp (str+n-m, suffix) == 0;
+}
+
+int main (int argc, char** argv)
+{
+	try {
+		if (argc == 3 && endsWith (argv[1], ".brain")) {
+			BrainFile brain (argv[1]);
+			ANNetwork* net = brain.toNetwork ();
+			ANNFileFormatLib::save (argv[2], *net);
+			delete net;
+		} else if (argc == 5) {
+			ANNetwork* net = ANNFileFormatLib::load (argv[1]);
+			BrainFile::save (argv[2], *net, atoi (argv[3]), atoi (argv[4]));
+			delete net;
+		} else {
+			fprintf (stderr, "Usage: brainconv input.net output.brain inputs outputs\n"
+					 "       brainconv input.brain output.net\n");
+			return 1;
+		}
+	} catch (generic_exception& e) {
+		fprintf (stderr, "brainconv: %s\n", e.what ());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+#include <magic/mclass.h>
+#include <magic/mmap.h>
+#include <nhp/individual.h>
+#include <inanna/annetwork.h>
+
+#include "annalee/anngenes.h"
+#include "annalee/miller.h"
+#include "annalee/layered.h"
+#include "annalee/kitano.h"
+#include "annalee/nolfi.h"
+#include "annalee/cangelosi.h"
+#include "annalee/neat.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocation counting
+///////////////////////////////////////////////////////////////////////////////
+
+static volatile long smAllocations = 0;
+
+void* operator new (size_t size) throw (std::bad_alloc)
+{
+	__sync_fetch_and_add (&smAllocations, 1);
+	void* p = malloc (size? size : 1);
+	if (!p)
+		throw std::bad_alloc ();
+	return p;
+}
+
+void operator delete (void* p) throw ()
+{
+	free (p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Timing
+///////////////////////////////////////////////////////////////////////////////
+
+static double now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+/** Accumulated cost of one benchmarked operation. */
+struct Measure {
+	double	ns;
+	long	allocs;
+	long	edges;
+	int		ops;
+
+	Measure () : ns (0), allocs (0), edges (0), ops (0) {}
+
+	void	start	() {mAllocs = smAllocations; mStart = now ();}
+	void	stop	(long opEdges=0) {
+		ns += now () - mStart;
+		allocs += smAllocations - mAllocs;
+		edges += opEdges;
+		ops++;
+	}
+
+  private:
+	double	mStart;
+	long	mAllocs;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+/** Parameters of the benchmarked networks. The swept parameter is set
+ *  on top of these.
+ **/
+static void baseParams (StringMap& params, int hidden)
+{
+	params.set ("inputs", "8");
+	params.set ("outputs", "2");
+	params.set ("ANNEncoding.maxHidden", String (hidden));
+	params.set ("ANNEncoding.prunePassthroughs", "1");
+	params.set ("MillerEncoding.pruneInputs", "1");
+	params.set ("MillerEncoding.pcAverage", "0.5");
+	params.set ("MillerEncoding.pcVariance", "0.1");
+	params.set ("layering", format ("8-%d-2", hidden));
+	params.set ("NolfiEncoding.types", "16");
+	params.set ("NolfiEncoding.tipRadius", "0.5");
+	params.set ("NolfiEncoding.neurons", String (hidden));
+}
+
+static ANNEncoding* createEncoding (const String& name, const StringMap& params)
+{
+	if (name == "miller")
+		return new MillerEncoding ("brainplan", params);
+	if (name == "layered")
+		return new LayeredEncoding ("brainplan", params);
+	if (name == "kitano")
+		return new KitanoEncoding ("brainplan", params);
+	if (name == "nolfi")
+		return new NolfiEncoding ("brainplan", params);
+	if (name == "cangelosi")
+		return new CangelosiEncoding ("brainplan", params);
+	if (name == "neat")
+		return new NEATEncoding ("brainplan", params);
+	ASSERTWITH (false, format ("Unknown encoding '%s'", (CONSTR) name));
+	return NULL;
+}
+
+static long countEdges (const ANNetwork& net)
+{
+	long edges = 0;
+	for (int i=0; i<net.size(); i++)
+		edges += net[i].incomings();
+	return edges;
+}
+
+static void report (const String& encoding, const char* param, int value,
+					const char* op, const Measure& m)
+{
+	double nsPerOp = m.ops? m.ns/m.ops : 0;
+	printf ("%s\t%s\t%d\t%s\t%.0f\t%.1f\t%.0f\n",
+			(CONSTR) encoding, param, value, op, nsPerOp,
+			m.ops? double (m.allocs)/m.ops : 0.0,
+			m.ns>0? m.edges/(m.ns*1e-9) : 0.0);
+}
+
+/** Benchmarks one encoding with one parameter value.
+ *
+ * The cleanup is timed on a copy of the decoded network, as the
+ * encodings clean up the networks they decode.
+ **/
+static void benchmark (const String& encoding, const char* param, int value, int reps)
+{
+	StringMap params;
+	baseParams (params, (String (param) == "ANNEncoding.maxHidden")? value : 10);
+	params.set (param, String (value));
+
+	Measure create, init, decode, cleanup;
+	for (int rep=0; rep<reps; rep++) {
+		create.start ();
+		ANNEncoding* enc = createEncoding (encoding, params);
+		enc->addPrivateGenes (*enc, params);
+		create.stop ();
+
+		init.start ();
+		enc->init ();
+		init.stop ();
+
+		Individual host;
+		decode.start ();
+		enc->execute (GeneticMsg ("brainplan", host));
+		const ANNetwork* net = dynamic_cast<const ANNetwork*> (host.getFeature ("brainplan"));
+		decode.stop (net? countEdges (*net) : 0);
+
+		if (net) {
+			ANNetwork* copy = new ANNetwork (*net);
+			cleanup.start ();
+			copy->cleanup (true, true);
+			cleanup.stop (countEdges (*copy));
+			delete copy;
+		}
+		delete enc;
+	}
+
+	report (encoding, param, value, "addPrivateGenes", create);
+	report (encoding, param, value, "init", init);
+	report (encoding, param, value, "execute", decode);
+	report (encoding, param, value, "cleanup", cleanup);
+	fflush (stdout);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+/** The parameter sweeps: encoding, swept parameter and its values,
+ *  terminated with 0.
+ **/
+static const struct {
+	const char*	encoding;
+	const char*	param;
+	int			values[6];
+} sweeps[] = {
+	{"miller",		"ANNEncoding.maxHidden",	{5, 10, 20, 40, 80, 0}},
+	{"layered",		"ANNEncoding.maxHidden",	{5, 10, 20, 40, 80, 0}},
+	{"neat",		"ANNEncoding.maxHidden",	{5, 10, 20, 40, 80, 0}},
+	{"kitano",		"KitanoEncoding.rewrites",	{3, 4, 5, 6, 0}},
+	{"nolfi",		"NolfiEncoding.neurons",	{5, 10, 20, 40, 80, 0}},
+	{"cangelosi",	"ANNEncoding.maxHidden",	{4, 8, 16, 32, 64, 0}},
+};
+
+int main (int argc, char** argv)
+{
+	int reps = (argc > 1)? atoi (argv[1]) : 100;
+	int seed = (argc > 2)? atoi (argv[2]) : 1;
+	srand (seed);
+
+	// Stable header: columns are only ever added at the end
+	printf ("# encbench 1\treps=%d\tseed=%d\n", reps, seed);
+	printf ("encoding\tparam\tvalue\top\tns_per_op\tallocs_per_op\tedges_per_sec\n");
+
+	for (unsigned int s=0; s<sizeof(sweeps)/sizeof(sweeps[0]); s++)
+		for (int v=0; sweeps[s].values[v]; v++)
+			benchmark (sweeps[s].encoding, sweeps[s].param, sweeps[s].values[v], reps);
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <magic/mmap.h>
+#include <magic/mclass.h>
+#include <nhp/individual.h>
+#include <inanna/patternset.h>
+
+#include "annalee/learningenv.h"
+#include "annalee/randomstream.h"
+
+/** Fills a pattern set with a classification problem around one
+ *  prototype per class. Private LCG, so that the data is the same on
+ *  every platform.
+ **/
+static void makeDataset (PatternSet& set, unsigned int seed)
+{
+	unsigned int state = seed*2654435761u + 1;
+#define NEXT() ((state = state*1664525u + 1013904223u) / 4294967296.0)
+	for (int p=0; p<set.patterns; p++) {
+		int c = int (NEXT ()*set.outputs) % set.outputs;
+		for (int i=0; i<set.inputs; i++)
+			set.set_input (p, i, (i%set.outputs == c) + 0.4*(NEXT ()-0.5));
+		for (int o=0; o<set.outputs; o++)
+			set.set_output (p, o, o==c);
+	}
+#undef NEXT
+}
+
+/** Evaluates a generation of one encoding both ways.
+ *
+ *  @return The number of individuals whose fitness differs.
+ **/
+static int check (const String& encoding, StringMap& params)
+{
+	const int size = 12;
+	PatternSet trainSet (60, 4, 2);
+	PatternSet evalSet (30, 4, 2);
+	PatternSet reportSet (30, 4, 2);
+	makeDataset (trainSet, 1);
+	makeDataset (evalSet, 2);
+	makeDataset (reportSet, 3);
+
+	params.set ("LearningEAEnv.encoding", encoding);
+	LearningEAEnv env (trainSet, evalSet, reportSet, params);
+
+	Individual* individuals[size];
+	for (int i=0; i<size; i++) {
+		RandomKey key;
+		key.seed       = env.seed ();
+		key.generation = env.generation ();
+		key.individual = i;
+		key.purpose    = RandomStream::INITIALIZATION;
+		RandomContext context (key);
+		individuals[i] = new Individual ();
+		env.addFeaturesTo (*individuals[i]);
+		individuals[i]->init ();
+	}
+
+	// One at a time, in the streams that evaluateAll uses
+	double serial[size];
+	for (int i=0; i<size; i++) {
+		RandomKey key;
+		key.seed       = env.seed ();
+		key.generation = env.generation ();
+		key.individual = i;
+		key.purpose    = RandomStream::TRAINING;
+		RandomContext context (key);
+		serial[i] = env.evaluateg (*individuals[i]);
+	}
+
+	double parallel[size];
+	env.evaluateAll (individuals, size, parallel);
+
+	int failures = 0;
+	for (int i=0; i<size; i++) {
+		bool ok = serial[i] == parallel[i];
+		printf ("%s\t%d\t%.17g\t%.17g\t%s\n", (CONSTR) encoding, i, serial[i], parallel[i],
+				ok? "ok" : "FAILED");
+		if (!ok)
+			failures++;
+		delete individuals[i];
+	}
+	return failures;
+}
+
+int main (int argc, char** argv)
+{
+	// Parameters are given as param=value pairs
+	StringMap params;
+	params.set ("LearningEAEnv.maxTrainCycles", "50");
+	params.set ("LearningEAEnv.terminator", "none");
+	params.set ("LearningEAEnv.pictureInterval", "0");
+	params.set ("LearningEAEnv.threads", "4");
+	params.set ("LearningEAEnv.seed", "7");
+	params.set ("NEATEncoding.recurrent", "1");
+	params.set ("logdir", "/tmp");
+	for (int i=1; i<argc; i++) {
+		String arg = argv[i];
+		int eq = arg.find ("=");
+		ASSERTWITH (eq > 0, format ("Parameter '%s' is not of form param=value", argv[i]));
+		params.set (arg.mid (0, eq), arg.mid (eq+1));
+	}
+
+	int failures = check ("layered", params) + check ("neat", params);
+	return failures? 1 : 0;
+}
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <magic/mmap.h>
+#include <magic/mclass.h>
+#include <magic/mtextstream.h>
+#include <nhp/individual.h>
+#include <nhp/population.h>
+#include <inanna/patternset.h>
+
+#include "annalee/learningenv.h"
+#include "annalee/generational.h"
+#include "annalee/arena.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// Synthetic datasets
+///////////////////////////////////////////////////////////////////////////////
+
+/** Fills a pattern set with a synthetic problem.
+ *
+ * In the classification problem the patterns are drawn around one
+ * random prototype per class, with uniform noise, and the outputs are
+ * one-of-N class codes. In the approximation problem the outputs are
+ * sums of sinusoids of random projections of the inputs.
+ *
+ * The generator is a private LCG, so the datasets are identical
+ * across platforms and builds.
+ **/
+static void makeDataset (PatternSet& set, bool classification, unsigned int seed)
+{
+	unsigned int state = seed*2654435761u + 1;
+#define NEXT() ((state = state*1664525u + 1013904223u) / 4294967296.0)
+
+	const int classes = (set.outputs>1)? set.outputs : 2;
+	double* prototypes = new double [classes*set.inputs];
+	double* projection = new double [set.outputs*set.inputs];
+	for (int i=0; i<classes*set.inputs; i++)
+		prototypes[i] = NEXT ();
+	for (int i=0; i<set.outputs*set.inputs; i++)
+		projection[i] = 2*NEXT ()-1;
+
+	for (int p=0; p<set.patterns; p++) {
+		if (classification) {
+			int c = int (NEXT ()*classes) % classes;
+			for (int i=0; i<set.inputs; i++)
+				set.set_input (p, i, prototypes[c*set.inputs+i] + 0.4*(NEXT ()-0.5));
+			for (int o=0; o<set.outputs; o++)
+				set.set_output (p, o, (set.outputs>1)? (o==c) : c);
+		} else {
+			for (int i=0; i<set.inputs; i++)
+				set.set_input (p, i, NEXT ());
+			for (int o=0; o<set.outputs; o++) {
+				double sum = 0;
+				for (int i=0; i<set.inputs; i++)
+					sum += projection[o*set.inputs+i]*set.input (p, i);
+				set.set_output (p, o, 0.5+0.4*sin (3*sum));
+			}
+		}
+	}
+#undef NEXT
+
+	delete [] prototypes;
+	delete [] projection;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Counting environment
+///////////////////////////////////////////////////////////////////////////////
+
+/** A learning environment that counts its generations and
+ *  evaluations.
+ **/
+class CountingEnv : public LearningEAEnv {
+  public:
+						CountingEnv		(const PatternSet& trainSet,
+										 const PatternSet& evalSet,
+										 const PatternSet& testSet,
+										 StringMap& params)
+								: LearningEAEnv (trainSet, evalSet, testSet, params),
+								  generations (0), evaluations (0), trainCycles (0) {
+		mCyclesPerEval = getOrDefault (params, "LearningEAEnv.maxTrainCycles", String(3000)).toInt ();
+	}
+
+	virtual double		evaluateg		(const Individual& ind) {
+		// Recurrent NEAT phenotypes are evaluated without training
+		if (isnull (ind["neatbrain"]))
+			__sync_fetch_and_add (&trainCycles, mCyclesPerEval);
+		__sync_fetch_and_add (&evaluations, 1);
+		return LearningEAEnv::evaluateg (ind);
+	}
+
+	virtual void		cycle_report	(OStream& log, OStream& out) {
+		generations++;
+		LearningEAEnv::cycle_report (log, out);
+	}
+
+	volatile long		generations;
+	volatile long		evaluations;
+	volatile long		trainCycles;
+
+  private:
+	int					mCyclesPerEval;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Main
+///////////////////////////////////////////////////////////////////////////////
+
+static double now ()
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+/** Runs the evolution with one encoding and prints its result line. */
+static void run (const String& encoding, StringMap& params)
+{
+	const int  patterns = getOrDefault (params, "patterns", String(200)).toInt ();
+	const int  inputs   = getOrDefault (params, "inputs", String(8)).toInt ();
+	const int  outputs  = getOrDefault (params, "outputs", String(2)).toInt ();
+	const int  seed     = getOrDefault (params, "seed", String(1)).toInt ();
+	const bool classify = getOrDefault (params, "problem", String("classification")) == "classification";
+	srand (seed);
+
+	// Two thirds for training, one third for evaluation, the report
+	// set is a separate sample of the same problem
+	PatternSet trainSet (patterns*2/3, inputs, outputs);
+	PatternSet evalSet (patterns-patterns*2/3, inputs, outputs);
+	PatternSet reportSet (patterns, inputs, outputs);
+	makeDataset (trainSet, classify, seed);
+	makeDataset (evalSet, classify, seed+1);
+	makeDataset (reportSet, classify, seed+2);
+
+	params.set ("LearningEAEnv.encoding", encoding);
+	params.set ("LearningEAEnv.terminator", "none");
+	params.set ("logdir", "/tmp");
+
+	CountingEnv env (trainSet, evalSet, reportSet, params);
+	if (!classify)
+		env.setProblemType (LearningEAEnv::APPROXIMATION);
+
+	double start = now ();
+	if (getOrDefault (params, "driver", String("generational")) == "simple") {
+		SimplePopulation population (env, params);
+		population.evolve ();
+	} else {
+		GenerationalEA population (env, params);
+		population.evolve (sout, sout);
+	}
+	double elapsed = now ()-start;
+
+	struct rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+
+	printf ("%s\t%s\t%d\t%d\t%d\t%ld\t%.3f\t%.3f\t%.1f\t%.0f\t%ld\t%ld\n",
+			(CONSTR) encoding, classify? "classification" : "approximation",
+			patterns, inputs, outputs, env.generations,
+			env.generations/elapsed, env.evaluations/elapsed,
+			env.trainCycles/elapsed, elapsed, usage.ru_maxrss,
+			(Arena::peak ()+1023)/1024);
+	fflush (stdout);
+}
+
+int main (int argc, char** argv)
+{
+	// Parameters are given as param=value pairs
+	StringMap params;
+	params.set ("LearningEAEnv.maxTrainCycles", "100");
+	params.set ("SimplePopulation.size", "50");
+	params.set ("GenerationalEA.size", "50");
+	params.set ("LearningEAEnv.pictureInterval", "0"); // The pictures are not benchmarked
+	for (int i=1; i<argc; i++) {
+		String arg = argv[i];
+		int eq = arg.find ("=");
+		ASSERTWITH (eq > 0, format ("Parameter '%s' is not of form param=value", argv[i]));
+		params.set (arg.mid (0, eq), arg.mid (eq+1));
+	}
+	params.set ("SimplePopulation.maxGenerations", getOrDefault (params, "generations", String(10)));
+	params.set ("GenerationalEA.maxGenerations", getOrDefault (params, "generations", String(10)));
+
+	static const char* encodings[] = {"layered", "miller", "kitano", "nolfi",
+									  "cangelosi", "neat", "substrate", NULL};
+	String which = getOrDefault (params, "encoding", String("all"));
+
+	printf ("# evobench 2\n");
+	printf ("encoding\tproblem\tpatterns\tinputs\toutputs\tgenerations\t"
+			"generations_per_sec\tevaluations_per_sec\ttrain_cycles_per_sec\t"
+			"seconds\tpeak_rss_kb\tarena_peak_kb\n");
+	fflush (stdout);
+
+	// Run each encoding in its own process to measure its peak RSS
+	for (int e=0; encodings[e]; e++) {
+		if (which != "all" && which != encodings[e])
+			continue;
+		pid_t pid = fork ();
+		if (pid == 0) {
+			run (encodings[e], params);
+			_exit (0);
+		}
+		int status;
+		waitpid (pid, &status, 0);
+		if (!WIFEXITED (status) || WEXITSTATUS (status))
+			fprintf (stderr, "evobench: encoding '%s' failed\n", encodings[e]);
+	}
+
+	return 0;
+}
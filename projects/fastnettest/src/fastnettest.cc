@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <magic/mclass.h>
+
+#include "fastnetwork.h"
+
+/** Private LCG, so that the networks are the same on every platform. */
+static float nextWeight (unsigned int& state)
+{
+	state = state*1664525u + 1013904223u;
+	return float (state / 4294967296.0 * 4.0 - 2.0);
+}
+
+/** Evaluates a network one unit at a time, in the logical weight
+ *  order and without any vectorization.
+ **/
+static void scalarUpdate (const FastNetwork& net, const float* pInputs, float* pOutputs)
+{
+	float act[2][64];
+	for (int i=0; i<net.layerSize (0); i++)
+		act[0][i] = pInputs[i];
+
+	int w = 0;
+	for (int l=1; l<4; l++) {
+		const float* in = act[(l-1)&1];
+		float* out = act[l&1];
+		const int sources = net.layerSize (l-1);
+		for (int j=0; j<net.layerSize (l); j++) {
+			float sum = net.weight (w + sources);
+			for (int k=0; k<sources; k++)
+				sum += net.weight (w+k) * in[k];
+			out[j] = FastNetwork::sigmoid (sum);
+			w += sources+1;
+		}
+	}
+
+	for (int o=0; o<net.layerSize (3); o++)
+		pOutputs[o] = act[1][o];
+}
+
+/** Compares update() and updateBatch() of one shape against the
+ *  scalar evaluation.
+ *
+ *  @return The largest absolute difference.
+ **/
+static double check (int inputs, int h1, int h2, int outputs)
+{
+	const int batch = 11;	// Blocks of four samples and a remainder
+	unsigned int state = inputs*1000 + h1*100 + h2*10 + outputs;
+
+	FastNetwork net (inputs, h1, h2, outputs);
+	for (int i=0; i<net.weights (); i++)
+		net.setWeight (i, nextWeight (state));
+
+	float* in = new float [batch*inputs];
+	float* out = new float [batch*outputs];
+	float* expected = new float [outputs];
+	for (int i=0; i<batch*inputs; i++)
+		in[i] = nextWeight (state);
+
+	net.updateBatch (in, batch, out);
+
+	double worst = 0.0;
+	for (int b=0; b<batch; b++) {
+		scalarUpdate (net, in + b*inputs, expected);
+		net.setInputs (in + b*inputs);
+		net.update ();
+		for (int o=0; o<outputs; o++) {
+			double d1 = fabs (net.getOutputs ()[o] - expected[o]);
+			double d2 = fabs (out[b*outputs+o] - expected[o]);
+			if (d1 > worst)
+				worst = d1;
+			if (d2 > worst)
+				worst = d2;
+		}
+	}
+
+	delete [] in;
+	delete [] out;
+	delete [] expected;
+	return worst;
+}
+
+int main (int argc, char** argv)
+{
+	static const int shapes[][4] = {
+		{4, 4, 4, 4}, {4, 4, 4, 1},		// Fixed-size variants
+		{4, 8, 8, 4}, {4, 8, 8, 1}, {4, 16, 16, 4},
+		{3, 5, 7, 2}, {9, 20, 13, 3},	// Padded layers
+	};
+	const double tolerance = 1e-5;
+
+	int failures = 0;
+	for (unsigned int s=0; s<sizeof(shapes)/sizeof(shapes[0]); s++) {
+		const int* sz = shapes[s];
+		double worst = check (sz[0], sz[1], sz[2], sz[3]);
+		bool ok = worst <= tolerance;
+		printf ("%d-%d-%d-%d\t%g\t%s\n", sz[0], sz[1], sz[2], sz[3], worst, ok? "ok" : "FAILED");
+		if (!ok)
+			failures++;
+	}
+
+	return failures? 1 : 0;
+}
@@ -41,7 +41,7 @@ include $(SRCDIR)/build/magicdef.mk
 ################################################################################
 # Recursively compile some subprojects
 ################################################################################
-makemodules = anngrammar # migration
+makemodules = anngrammar brainconv encbench evaltest evobench fastnettest speciestest # migration
 
 ################################################################################
 # Compile
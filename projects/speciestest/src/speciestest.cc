@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <magic/mmap.h>
+#include <magic/mclass.h>
+
+#include "annalee/neatspecies.h"
+
+/** Private LCG, so that the genomes are the same on every platform. */
+static double nextNoise (unsigned int& state)
+{
+	state = state*1664525u + 1013904223u;
+	return state / 4294967296.0 * 0.2 - 0.1;
+}
+
+/** Makes a genome of the given family. The families have disjoint
+ *  innovation numbers, and the members of a family differ only by
+ *  small weight perturbations.
+ **/
+static void makeGenome (NEATGenome& genome, int family, unsigned int& state)
+{
+	genome.clear ();
+	for (int k=0; k<6; k++)
+		genome.add (100*(family+1)+k, k%3, 3+k%2, 0.5+nextNoise (state));
+}
+
+/** Speciates the population and checks that each family forms a
+ *  species of its own.
+ *
+ *  @return The number of misplaced genomes.
+ **/
+static int check (NEATSpeciation& speciation, const NEATGenome* const* genomes,
+				  int n, int families, int round)
+{
+	int* species = new int [n];
+	speciation.speciate (genomes, n, species);
+
+	int failures = (speciation.species () == families)? 0 : 1;
+	for (int i=0; i<n; i++) {
+		// All the members of a family must be in the species of its first member
+		if (species[i] != species[i%families])
+			failures++;
+		if (i >= families)
+			continue;
+		for (int j=0; j<i; j++)
+			if (species[j] == species[i])
+				failures++;
+	}
+	printf ("round %d\t%d species\t%s\n", round, speciation.species (),
+			failures? "FAILED" : "ok");
+	delete [] species;
+	return failures;
+}
+
+int main (int argc, char** argv)
+{
+	const int families = 3;
+	const int n = 30;
+	StringMap params;
+	params.set ("NEATSpeciation.threads", "4");
+
+	NEATGenome* population = new NEATGenome [n];
+	const NEATGenome** genomes = new const NEATGenome* [n];
+	unsigned int state = 1;
+	for (int i=0; i<n; i++) {
+		makeGenome (population[i], i%families, state);
+		genomes[i] = &population[i];
+	}
+
+	NEATSpeciation speciation (params);
+	int failures = check (speciation, genomes, n, families, 1);
+
+	// The next generation is compared with the representatives
+	for (int i=0; i<n; i++)
+		makeGenome (population[i], i%families, state);
+	failures += check (speciation, genomes, n, families, 2);
+
+	delete [] genomes;
+	delete [] population;
+	return failures? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#include <stdlib.h>
+#include <pthread.h>
+#include <new>
+#include <magic/mclass.h>
+#include <annalee/arena.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//                         _                                                //
+//                        / \       ___   _     ___                         //
+//                       /   \ |/\ /   ) |/ \   ___|                        //
+//                       |---| |   |---  |   | (   |                        //
+//                       |   | |    \__  |   |  \__|                        //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+long Arena::smPeak = 0;
+
+Arena::Arena (long chunkSize)
+		: mOffset (0), mUsedBefore (0), mHighWater (0), mChunkSize (chunkSize), mFrames (0)
+{
+	ASSERT (chunkSize > 0);
+	mpFirst = static_cast<Chunk*> (malloc (sizeof(Chunk) + mChunkSize));
+	if (!mpFirst)
+		throw std::bad_alloc ();
+	mpFirst->next = NULL;
+	mpFirst->size = mChunkSize;
+	mpCurrent = mpFirst;
+}
+
+Arena::~Arena ()
+{
+	while (mpFirst) {
+		Chunk* next = mpFirst->next;
+		free (mpFirst);
+		mpFirst = next;
+	}
+}
+
+/*******************************************************************************
+ * Allocates from the current chunk, or from the next chunk that is
+ * large enough. The chunks of earlier individuals are reused before
+ * new ones are allocated.
+ ******************************************************************************/
+void* Arena::allocate (long size, long align)
+{
+	long offset = (mOffset + align - 1) & ~(align - 1);
+	if (offset + size > mpCurrent->size) {
+		nextChunk (size + align);
+		offset = 0;
+	}
+	mOffset = offset + size;
+
+	long total = mUsedBefore + mOffset;
+	if (total > mHighWater) {
+		mHighWater = total;
+		long peak = smPeak;
+		while (total > peak && !__sync_bool_compare_and_swap (&smPeak, peak, total))
+			peak = smPeak;
+	}
+	return data (mpCurrent) + offset;
+}
+
+/** Moves to a chunk with room for the given number of bytes. */
+void Arena::nextChunk (long size)
+{
+	mUsedBefore += mOffset;
+	mOffset = 0;
+
+	// A chunk that is too small for the request is skipped
+	while (mpCurrent->next && mpCurrent->next->size < size)
+		mpCurrent = mpCurrent->next;
+	if (mpCurrent->next) {
+		mpCurrent = mpCurrent->next;
+		return;
+	}
+
+	long chunkSize = (size > mChunkSize)? size : mChunkSize;
+	Chunk* chunk = static_cast<Chunk*> (malloc (sizeof(Chunk) + chunkSize));
+	if (!chunk)
+		throw std::bad_alloc ();
+	chunk->next = NULL;
+	chunk->size = chunkSize;
+	mpCurrent->next = chunk;
+	mpCurrent = chunk;
+}
+
+Arena::Mark Arena::mark () const
+{
+	Mark mark;
+	mark.chunk      = mpCurrent;
+	mark.offset     = mOffset;
+	mark.usedBefore = mUsedBefore;
+	return mark;
+}
+
+void Arena::release (const Mark& mark)
+{
+	mpCurrent   = static_cast<Chunk*> (mark.chunk);
+	mOffset     = mark.offset;
+	mUsedBefore = mark.usedBefore;
+}
+
+void Arena::reset ()
+{
+	ASSERTWITH (mFrames == 0, "Arena reset inside a frame");
+	mpCurrent   = mpFirst;
+	mOffset     = 0;
+	mUsedBefore = 0;
+}
+
+/*******************************************************************************
+ * The arena of each thread is kept in thread-specific data and
+ * deleted when the thread exits.
+ ******************************************************************************/
+static pthread_key_t	sArenaKey;
+static pthread_once_t	sArenaOnce = PTHREAD_ONCE_INIT;
+
+static void deleteArena (void* arena)
+{
+	delete static_cast<Arena*> (arena);
+}
+
+static void createArenaKey ()
+{
+	pthread_key_create (&sArenaKey, deleteArena);
+}
+
+Arena& Arena::current ()
+{
+	pthread_once (&sArenaOnce, createArenaKey);
+	Arena* arena = static_cast<Arena*> (pthread_getspecific (sArenaKey));
+	if (!arena) {
+		arena = new Arena ();
+		pthread_setspecific (sArenaKey, arena);
+	}
+	return *arena;
+}
+
+/*******************************************************************************
+ * The objects are preceded by a header that tells whether they are in
+ * an arena. The header keeps the objects aligned to 16 bytes.
+ ******************************************************************************/
+void* Arena::newObject (size_t size)
+{
+	Arena& arena = current ();
+	long* header;
+	if (arena.mFrames > 0) {
+		header = static_cast<long*> (arena.allocate (long (size) + 16, 16));
+		header[0] = 1;
+	} else {
+		header = static_cast<long*> (malloc (size + 16));
+		if (!header)
+			throw std::bad_alloc ();
+		header[0] = 0;
+	}
+	return header + 2;
+}
+
+void Arena::deleteObject (void* object)
+{
+	if (!object)
+		return;
+	long* header = static_cast<long*> (object) - 2;
+	if (header[0] == 0)
+		free (header);
+}
+
+ArenaFrame::ArenaFrame ()
+		: mrArena (Arena::current ()), mMark (mrArena.mark ())
+{
+	mrArena.mFrames++;
+}
+
+ArenaFrame::~ArenaFrame ()
+{
+	mrArena.mFrames--;
+	mrArena.release (mMark);
+}
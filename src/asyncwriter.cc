@@ -0,0 +1,188 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <magic/mclass.h>
+#include <annalee/asyncwriter.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//           _                           |   |     o                        //
+//          / \               _          |   |        |    ___              //
+//         /   \  ___  |   | |/ \   ___  | | | |/\ |  -+- /   ) |/\         //
+//         |---| (     |   | |   | /     |\ /| |   |  |   |---  |           //
+//         |   |  ---)  \__| |   | \___  |   | |   |   \   \__  |           //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+void FileWriteJob::run ()
+{
+	FILE* out = fopen (mFilename, "w");
+	if (!out)
+		throw generic_exception (format ("Could not open '%s' for writing", (CONSTR) mFilename));
+	bool ok = fwrite ((CONSTR) mData, 1, mData.length (), out) == size_t (mData.length ());
+	ok = (fclose (out) == 0) && ok;
+	if (!ok)
+		throw generic_exception (format ("Could not write '%s'", (CONSTR) mFilename));
+}
+
+AsyncWriter::AsyncWriter (int capacity)
+		: mpQueue (NULL), mCapacity (capacity), mHead (0), mCount (0),
+		  mBusy (false), mStopping (false)
+{
+	if (mCapacity <= 0)
+		return;
+
+	mpQueue = new AsyncJob* [mCapacity];
+	pthread_mutex_init (&mMutex, NULL);
+	pthread_cond_init (&mChanged, NULL);
+	if (pthread_create (&mThread, NULL, writerThread, this) != 0)
+		throw generic_exception ("Could not start the writer thread");
+}
+
+AsyncWriter::~AsyncWriter ()
+{
+	if (mCapacity <= 0)
+		return;
+
+	pthread_mutex_lock (&mMutex);
+	mStopping = true;
+	pthread_cond_broadcast (&mChanged);
+	pthread_mutex_unlock (&mMutex);
+
+	// The writer runs the remaining jobs before it exits
+	pthread_join (mThread, NULL);
+	pthread_cond_destroy (&mChanged);
+	pthread_mutex_destroy (&mMutex);
+	delete [] mpQueue;
+
+	// Nobody is left to flush, so the error can only be printed
+	if (mError.length () > 0)
+		fprintf (stderr, "AsyncWriter: %s\n", (CONSTR) mError);
+}
+
+void AsyncWriter::submit (AsyncJob* job)
+{
+	if (mCapacity <= 0) {
+		runJob (job);
+		flush ();
+		return;
+	}
+
+	pthread_mutex_lock (&mMutex);
+	while (mCount == mCapacity)
+		pthread_cond_wait (&mChanged, &mMutex);
+	mpQueue[(mHead+mCount) % mCapacity] = job;
+	mCount++;
+	pthread_cond_broadcast (&mChanged);
+	pthread_mutex_unlock (&mMutex);
+}
+
+void AsyncWriter::flush ()
+{
+	if (mCapacity > 0) {
+		pthread_mutex_lock (&mMutex);
+		while (mCount > 0 || mBusy)
+			pthread_cond_wait (&mChanged, &mMutex);
+	}
+
+	String error = mError;
+	mError = "";
+
+	if (mCapacity > 0)
+		pthread_mutex_unlock (&mMutex);
+
+	if (error.length () > 0)
+		throw generic_exception (error);
+}
+
+void AsyncWriter::checkErrors ()
+{
+	if (mCapacity > 0)
+		pthread_mutex_lock (&mMutex);
+
+	String error = mError;
+	mError = "";
+
+	if (mCapacity > 0)
+		pthread_mutex_unlock (&mMutex);
+
+	if (error.length () > 0)
+		throw generic_exception (error);
+}
+
+void* AsyncWriter::writerThread (void* self)
+{
+	((AsyncWriter*) self)->runJobs ();
+	return NULL;
+}
+
+void AsyncWriter::runJobs ()
+{
+	pthread_mutex_lock (&mMutex);
+	while (true) {
+		while (mCount == 0 && !mStopping)
+			pthread_cond_wait (&mChanged, &mMutex);
+		if (mCount == 0)
+			break;	// Stopping and nothing left to write
+
+		AsyncJob* job = mpQueue[mHead];
+		mHead = (mHead+1) % mCapacity;
+		mCount--;
+		mBusy = true;
+		pthread_cond_broadcast (&mChanged);
+
+		// Run the job without holding the lock
+		pthread_mutex_unlock (&mMutex);
+		runJob (job);
+		pthread_mutex_lock (&mMutex);
+
+		mBusy = false;
+		pthread_cond_broadcast (&mChanged);
+	}
+	pthread_mutex_unlock (&mMutex);
+}
+
+/*******************************************************************************
+ * Runs and deletes a job, keeping the first error message.
+ ******************************************************************************/
+void AsyncWriter::runJob (AsyncJob* job)
+{
+	String error;
+	try {
+		job->run ();
+	} catch (generic_exception& e) {
+		error = e.what ();
+	}
+	delete job;
+
+	if (error.length () > 0) {
+		if (mCapacity > 0)
+			pthread_mutex_lock (&mMutex);
+		if (mError.length () == 0)
+			mError = error;
+		if (mCapacity > 0)
+			pthread_mutex_unlock (&mMutex);
+	}
+}
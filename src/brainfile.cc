@@ -0,0 +1,209 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <magic/mclass.h>
+#include <inanna/annetwork.h>
+#include <annalee/brainfile.h>
+
+#define BRAINFILE_MAGIC		"ANNBRN"
+#define BRAINFILE_VERSION	1
+#define BRAINFILE_BOM		0x01020304
+
+static long align8 (long x) {return (x+7) & ~7L;}
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//                ----            o        ----- o  |                       //
+//                |   )      ___      _    |        |  ___                  //
+//                |---< |/\  ___| |  |/ \  |---  |  | /   )                 //
+//                |   ) |   (   | |  |   | |     |  | |---                  //
+//                |___) |    \__| |  |   | |     |  |  \__                  //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+BrainFile::BrainFile (const String& filename)
+		: mpMap (MAP_FAILED), mLength (0)
+{
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0)
+		throw generic_exception (format ("Could not open brain file '%s'", (CONSTR) filename));
+	struct stat st;
+	if (fstat (fd, &st) == 0 && st.st_size >= long (sizeof(Header))) {
+		mLength = st.st_size;
+		mpMap = mmap (NULL, mLength, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close (fd);
+	if (mpMap == MAP_FAILED)
+		throw generic_exception (format ("Could not map brain file '%s'", (CONSTR) filename));
+
+	if (!attach (mpMap, mLength)) {
+		munmap (mpMap, mLength);
+		throw generic_exception (format ("Malformed brain file '%s'", (CONSTR) filename));
+	}
+}
+
+BrainFile::BrainFile (const void* data, long length)
+		: mpMap (MAP_FAILED), mLength (length)
+{
+	if (!attach (data, length))
+		throw generic_exception ("Malformed brain image");
+}
+
+BrainFile::~BrainFile ()
+{
+	if (mpMap != MAP_FAILED)
+		munmap (mpMap, mLength);
+}
+
+/*******************************************************************************
+ * Sets up the array pointers to a brain image, after checking that
+ * the arrays lie within the image.
+ ******************************************************************************/
+bool BrainFile::attach (const void* data, long length)
+{
+	if (length < long (sizeof(Header)))
+		return false;
+
+	mpHeader = (const Header*) data;
+	const Header& h = *mpHeader;
+	bool ok = memcmp (h.magic, BRAINFILE_MAGIC, sizeof(BRAINFILE_MAGIC)) == 0
+		&& h.version == BRAINFILE_VERSION && h.byteOrder == BRAINFILE_BOM
+		&& h.units >= h.inputs + h.outputs && h.inputs >= 0 && h.outputs >= 0
+		&& h.connections >= 0
+		&& h.startOffset  >= long (sizeof(Header)) && h.startOffset  + (h.units+1)*long (sizeof(int))    <= length
+		&& h.sourceOffset >= long (sizeof(Header)) && h.sourceOffset + h.connections*long (sizeof(int))  <= length
+		&& h.weightOffset >= long (sizeof(Header)) && h.weightOffset + h.connections*long (sizeof(double)) <= length
+		&& h.biasOffset   >= long (sizeof(Header)) && h.biasOffset   + h.units*long (sizeof(double))     <= length
+		&& (h.weightOffset & 7) == 0 && (h.biasOffset & 7) == 0;
+	if (ok) {
+		mpStart  = (const int*)    ((const char*) data + h.startOffset);
+		mpSource = (const int*)    ((const char*) data + h.sourceOffset);
+		mpWeight = (const double*) ((const char*) data + h.weightOffset);
+		mpBias   = (const double*) ((const char*) data + h.biasOffset);
+		ok = mpStart[0] == 0 && mpStart[h.units] == h.connections;
+		for (int u=0; ok && u<h.units; u++)
+			ok = mpStart[u] <= mpStart[u+1];
+		for (int k=0; ok && k<h.connections; k++)
+			ok = mpSource[k] >= 0 && mpSource[k] < h.units;
+	}
+	return ok;
+}
+
+ANNetwork* BrainFile::toNetwork () const
+{
+	ANNetwork* net = new ANNetwork (format ("%d-%d-%d", inputs (),
+											units () - inputs () - outputs (), outputs ()));
+	for (int t=0; t<units (); t++) {
+		Neuron& neuron = (*net)[t];
+		neuron.setBias (mpBias[t]);
+		for (int k=mpStart[t]; k<mpStart[t+1]; k++) {
+			net->connect (mpSource[k], t);
+			neuron.incoming (neuron.incomings()-1).setWeight (mpWeight[k]);
+		}
+	}
+	return net;
+}
+
+/*******************************************************************************
+ * Saves a network in the binary format.
+ *
+ * The file is written under a temporary name and renamed, so that
+ * readers never map a partially written file.
+ ******************************************************************************/
+void BrainFile::save (const String& filename, const ANNetwork& net, int inputs, int outputs)
+{
+	long length;
+	char* image = pack (net, inputs, outputs, length);
+
+	String tmpName = filename + ".tmp";
+	FILE* out = fopen (tmpName, "wb");
+	bool ok = out && fwrite (image, 1, length, out) == size_t (length);
+	if (out)
+		ok = (fclose (out) == 0) && ok;
+	delete [] image;
+
+	if (!ok || rename (tmpName, filename) != 0) {
+		unlink (tmpName);
+		throw generic_exception (format ("Could not write brain file '%s'", (CONSTR) filename));
+	}
+}
+
+char* BrainFile::pack (const ANNetwork& net, int inputs, int outputs, long& length)
+{
+	Header h;
+	memset (&h, 0, sizeof(h));
+	strcpy (h.magic, BRAINFILE_MAGIC);
+	h.version	= BRAINFILE_VERSION;
+	h.byteOrder	= BRAINFILE_BOM;
+	h.units		= net.size ();
+	h.inputs	= inputs;
+	h.outputs	= outputs;
+	ASSERT (h.units >= inputs+outputs);
+
+	// Collect the arrays
+	int* start = new int [h.units+1];
+	start[0] = 0;
+	for (int t=0; t<h.units; t++)
+		start[t+1] = start[t] + net[t].incomings ();
+	h.connections = start[h.units];
+
+	int*    source = new int [h.connections+1];
+	double* weight = new double [h.connections+1];
+	double* bias   = new double [h.units+1];
+	for (int t=0; t<h.units; t++) {
+		const Neuron& neuron = net[t];
+		bias[t] = neuron.bias ();
+		for (int j=0; j<neuron.incomings (); j++) {
+			source[start[t]+j] = neuron.incoming(j).source().id ();
+			weight[start[t]+j] = neuron.incoming(j).weight ();
+		}
+	}
+
+	h.startOffset	= align8 (sizeof(Header));
+	h.sourceOffset	= align8 (h.startOffset + (h.units+1)*sizeof(int));
+	h.weightOffset	= align8 (h.sourceOffset + h.connections*sizeof(int));
+	h.biasOffset	= h.weightOffset + h.connections*sizeof(double);
+	length = h.biasOffset + h.units*sizeof(double);
+
+	// The allocation is aligned for the double arrays
+	char* image = new char [length];
+	memset (image, 0, length);
+	memcpy (image, &h, sizeof(h));
+	memcpy (image+h.startOffset, start, (h.units+1)*sizeof(int));
+	memcpy (image+h.sourceOffset, source, h.connections*sizeof(int));
+	memcpy (image+h.weightOffset, weight, h.connections*sizeof(double));
+	memcpy (image+h.biasOffset, bias, h.units*sizeof(double));
+	delete [] start;
+	delete [] source;
+	delete [] weight;
+	delete [] bias;
+
+	return image;
+}
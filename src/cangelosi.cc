@@ -29,6 +29,7 @@
 
 #include "annalee/cangelosi.h"
 #include "annalee/cangelosinet.h"
+#include "annalee/randomstream.h"
 
 impl_dynamic (CangelosiEncoding, {NolfiEncoding});
 
@@ -79,7 +80,9 @@ bool CangelosiEncoding::execute (const GeneticMsg& msg) const {
 	if (getGene("tipr"))
 		tipRadius	= ((const AnyFloatGene*) getGene("tipr"))->getvalue();
 	
-	// Rewrite for some cycles
+	// Rewrite for some cycles. The cells are allocated from the arena
+	// and released with the frame.
+	ArenaFrame frame;
 	CangelosiNet cnet (mInputs, mMaxHidden, mOutputs, mXSize, mYSize, tipRadius, mAxonScale);
 	cnet.rewrite (rules, int(log(mMaxHidden*1.0)/log(2.0)+0.99));
 
@@ -88,12 +91,17 @@ bool CangelosiEncoding::execute (const GeneticMsg& msg) const {
 		
 	// Add the plan to the host
 	if (net) {
-		net->setInitializer (new GaussianInitializer ());
+		net->setInitializer (new StreamInitializer ());
 		
 		// Take pictures only if this is a picture-taking recreation
 		bool takePics = dynamic_cast<const TakeBrainPicsMsg*>(&msg) != NULL;
 		if (takePics) {
-			msg.mrHost.set ("brainpic1", new String (cnet.drawEPS()));
+			// The cell space picture may be large, so it is streamed
+			const TakeBrainPicsMsg& picMsg = static_cast<const TakeBrainPicsMsg&> (msg);
+			if (picMsg.mPath.length () > 0)
+				streamBrainPic (cnet, picMsg.mPath, "-pic1.eps");
+			else
+				msg.mrHost.set ("brainpic1", new String (cnet.drawEPS()));
 			msg.mrHost.set ("brainpic2", new String (net->drawEPS()));
 		}
 		net->cleanup (true, mPrunePassthroughs);
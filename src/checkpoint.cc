@@ -0,0 +1,192 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <magic/mclass.h>
+#include <annalee/checkpoint.h>
+
+#define CHECKPOINT_MAGIC	"ANNCKPT"
+#define CHECKPOINT_VERSION	1
+
+static long align8 (long x) {return (x+7) & ~7L;}
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//            ___  |                 |              o                       //
+//           /   \ |      ___        |                  _    |              //
+//           |     |/ \  /   )  ___  | /  |--   __  |  |/ \  -+-            //
+//           |     |   | |---  /     |<   |  ) /  \ |  |   | |              //
+//           \___/ |   |  \__  \___  | \  |--  \__/ |  |   |  \             //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+CheckpointWriter::CheckpointWriter ()
+		: mpSections (NULL), mSections (0), mCapacity (0)
+{
+}
+
+CheckpointWriter::~CheckpointWriter ()
+{
+	for (int i=0; i<mSections; i++)
+		delete [] mpSections[i].data;
+	delete [] mpSections;
+}
+
+void CheckpointWriter::add (const char* tag, const void* data, long size)
+{
+	memcpy (reserve (tag, size), data, size);
+}
+
+void* CheckpointWriter::reserve (const char* tag, long size)
+{
+	ASSERTWITH (strlen (tag) < 8, "Checkpoint section tags are at most 7 characters");
+	ASSERT (size >= 0);
+
+	if (mSections == mCapacity) {
+		mCapacity = mCapacity? mCapacity*2 : 8;
+		Section* sections = new Section [mCapacity];
+		if (mSections > 0)
+			memcpy (sections, mpSections, mSections*sizeof(Section));
+		delete [] mpSections;
+		mpSections = sections;
+	}
+
+	Section& section = mpSections[mSections++];
+	memset (section.tag, 0, sizeof(section.tag));
+	strcpy (section.tag, tag);
+	section.data = new char [size? size : 1];
+	section.size = size;
+	return section.data;
+}
+
+/*******************************************************************************
+ * Writes the checkpoint.
+ *
+ * The file is written under a temporary name, flushed to the disk and
+ * then renamed over the old checkpoint.
+ ******************************************************************************/
+void CheckpointWriter::write (const String& filename) const
+{
+	Checkpoint::Header header;
+	memset (&header, 0, sizeof(header));
+	strcpy (header.magic, CHECKPOINT_MAGIC);
+	header.version  = CHECKPOINT_VERSION;
+	header.sections = mSections;
+
+	// Lay out the sections after the table
+	Checkpoint::Entry* table = new Checkpoint::Entry [mSections];
+	long offset = align8 (sizeof(header) + mSections*sizeof(Checkpoint::Entry));
+	for (int i=0; i<mSections; i++) {
+		memcpy (table[i].tag, mpSections[i].tag, sizeof(table[i].tag));
+		table[i].offset = offset;
+		table[i].size   = mpSections[i].size;
+		offset = align8 (offset + mpSections[i].size);
+	}
+
+	String tmpName = filename + ".tmp";
+	FILE* out = fopen (tmpName, "wb");
+	bool ok = out != NULL;
+	if (ok) {
+		static const char padding[8] = {0};
+		long written = sizeof(header) + mSections*sizeof(Checkpoint::Entry);
+		ok = fwrite (&header, sizeof(header), 1, out) == 1;
+		ok = ok && fwrite (table, sizeof(Checkpoint::Entry), mSections, out) == size_t (mSections);
+		for (int i=0; ok && i<mSections; i++) {
+			ok = fwrite (padding, 1, table[i].offset-written, out) == size_t (table[i].offset-written);
+			ok = ok && fwrite (mpSections[i].data, 1, mpSections[i].size, out) == size_t (mpSections[i].size);
+			written = table[i].offset + mpSections[i].size;
+		}
+		ok = (fflush (out) == 0) && ok;
+		ok = ok && fsync (fileno (out)) == 0;
+		ok = (fclose (out) == 0) && ok;
+	}
+	delete [] table;
+
+	if (!ok || rename (tmpName, filename) != 0) {
+		unlink (tmpName);
+		throw generic_exception (format ("Could not write checkpoint '%s'", (CONSTR) filename));
+	}
+}
+
+Checkpoint::Checkpoint (const String& filename)
+		: mpMap (MAP_FAILED), mLength (0), mpTable (NULL), mSections (0)
+{
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0)
+		throw generic_exception (format ("Could not open checkpoint '%s'", (CONSTR) filename));
+	struct stat st;
+	if (fstat (fd, &st) == 0 && st.st_size >= long (sizeof(Header))) {
+		mLength = st.st_size;
+		mpMap = mmap (NULL, mLength, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close (fd);
+	if (mpMap == MAP_FAILED)
+		throw generic_exception (format ("Could not map checkpoint '%s'", (CONSTR) filename));
+
+	// Validate the header and the section table before trusting them
+	const Header* header = (const Header*) mpMap;
+	bool ok = memcmp (header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0
+		&& header->version == CHECKPOINT_VERSION
+		&& header->sections >= 0
+		&& long (sizeof(Header) + header->sections*sizeof(Entry)) <= mLength;
+	if (ok) {
+		mpTable   = (const Entry*) (header+1);
+		mSections = header->sections;
+		for (int i=0; ok && i<mSections; i++)
+			ok = mpTable[i].offset >= 0 && mpTable[i].size >= 0
+				&& mpTable[i].offset + mpTable[i].size <= mLength
+				&& mpTable[i].tag[7] == 0;
+	}
+	if (!ok) {
+		munmap (mpMap, mLength);
+		throw generic_exception (format ("Malformed checkpoint '%s'", (CONSTR) filename));
+	}
+}
+
+Checkpoint::~Checkpoint ()
+{
+	munmap (mpMap, mLength);
+}
+
+const void* Checkpoint::section (const char* tag, long* size) const
+{
+	for (int i=0; i<mSections; i++)
+		if (strcmp (mpTable[i].tag, tag) == 0) {
+			if (size)
+				*size = mpTable[i].size;
+			return (const char*) mpMap + mpTable[i].offset;
+		}
+	return NULL;
+}
+
+bool Checkpoint::exists (const String& filename)
+{
+	struct stat st;
+	return stat (filename, &st) == 0;
+}
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <magic/mclass.h>
+#include <annalee/epsstream.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//           ----- ----   ___   ___                                         //
+//           |     |   ) (   \ (   \ |        ___   ___                     //
+//           |---  |---   \__   \__  -+- |/\ /   )  ___| |/\/\              //
+//           |     |         )     ) |   |   |---  (   | |  |  |            //
+//           |____ |     \___) \___)  \  |    \__   \__| |  |  |            //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+EPSStream::EPSStream (int fd, const Coord2D& size)
+		: mFd (fd), mSize (size), mUsed (0), mClipped (false)
+{
+	printf ("%%!PS-Adobe-3.0 EPSF-3.0\n"
+			"%%%%BoundingBox: 0 0 %d %d\n"
+			"%%%%Creator: Annalee\n"
+			"%%%%EndComments\n"
+			"/L {newpath moveto lineto stroke} bind def\n"
+			"/C {newpath 0 360 arc stroke} bind def\n"
+			"/CF {newpath 0 360 arc fill} bind def\n",
+			int (size.x+0.5), int (size.y+0.5));
+}
+
+EPSStream::~EPSStream ()
+{
+	// Errors can not be thrown from here; printFooter reports them
+	if (mUsed > 0)
+		write (mFd, mBuffer, mUsed);
+}
+
+void EPSStream::framedStyle (double width, double height)
+{
+	printf ("gsave %g %g scale\n", mSize.x/width, mSize.y/height);
+	printf ("%g setlinewidth newpath 0 0 moveto %g 0 lineto %g %g lineto 0 %g lineto "
+			"closepath gsave stroke grestore clip\n",
+			width/mSize.x, width, width, height, height);
+	mClipped = true;
+}
+
+void EPSStream::lineWidth (double width)
+{
+	printf ("%g setlinewidth\n", width);
+}
+
+void EPSStream::lineStyle (const char* style, double unit)
+{
+	if (!strcmp (style, "dashed"))
+		printf ("[%g %g] 0 setdash\n", 3*unit, 3*unit);
+	else if (!strcmp (style, "dotted"))
+		printf ("[%g %g] 0 setdash\n", unit, 2*unit);
+	else
+		printf ("[] 0 setdash\n");
+}
+
+void EPSStream::line (const Coord2D& start, const Coord2D& end)
+{
+	printf ("%g %g %g %g L\n", end.x, end.y, start.x, start.y);
+}
+
+void EPSStream::circle (const Coord2D& center, double radius, bool filled)
+{
+	printf ("%g %g %g %s\n", center.x, center.y, radius, filled? "CF" : "C");
+}
+
+void EPSStream::printFooter ()
+{
+	if (mClipped)
+		printf ("grestore\n");
+	mClipped = false;
+	printf ("showpage\n%%%%EOF\n");
+	flush ();
+}
+
+/*******************************************************************************
+ * Formats a command to the buffer, flushing it first if the command
+ * might not fit. A single command is always much shorter than the
+ * buffer.
+ ******************************************************************************/
+void EPSStream::printf (const char* fmt, ...)
+{
+	if (mUsed > int (sizeof(mBuffer)) - 512)
+		flush ();
+
+	va_list args;
+	va_start (args, fmt);
+	int n = vsnprintf (mBuffer+mUsed, sizeof(mBuffer)-mUsed, fmt, args);
+	va_end (args);
+	ASSERT (n >= 0 && mUsed+n < int (sizeof(mBuffer)));
+	mUsed += n;
+}
+
+void EPSStream::flush ()
+{
+	const char* p = mBuffer;
+	while (mUsed > 0) {
+		ssize_t n = write (mFd, p, mUsed);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			mUsed = 0;
+			throw generic_exception (format ("Could not write EPS picture: %s", strerror (errno)));
+		}
+		p += n;
+		mUsed -= n;
+	}
+}
@@ -0,0 +1,252 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <sched.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <magic/mclass.h>
+#include <annalee/evalfarm.h>
+
+/** Reads exactly the given number of bytes, unless the peer closes
+ *  the connection first.
+ **/
+static bool readFully (int fd, void* buffer, long length)
+{
+	char* p = (char*) buffer;
+	while (length > 0) {
+		ssize_t n = recv (fd, p, length, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		length -= n;
+	}
+	return true;
+}
+
+/** Writes the whole buffer. A closed peer is reported as a failure
+ *  instead of a SIGPIPE.
+ **/
+static bool writeFully (int fd, const void* buffer, long length)
+{
+	const char* p = (const char*) buffer;
+	while (length > 0) {
+		ssize_t n = ::send (fd, p, length, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		length -= n;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//-----             |                 o             -----                   //
+//|            ___  |        ___  |            _    |      ___              //
+//|---  |   |  ___| | |   |  ___| -+- |   __  |/ \  |---   ___| |/\ |/\/\   //
+//|      \ /  (   | | |   | (   | |   |  /  \ |   | |     (   | |   |  |  | //
+//|____   V    \__| |  \__!  \__|  \  |  \__/ |   | |      \__| |   |  |  | //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+EvaluationFarm::EvaluationFarm (int workers, FarmTask& task, bool pin)
+		: mpWorkers (new Worker [workers]), mWorkers (0), mLive (0)
+{
+	ASSERT (workers > 0);
+	pthread_mutex_init (&mMutex, NULL);
+	pthread_cond_init (&mFreed, NULL);
+
+	const long processors = sysconf (_SC_NPROCESSORS_ONLN);
+	fflush (NULL); // Don't let the workers inherit unwritten output
+
+	for (int w=0; w<workers; w++) {
+		int fds[2];
+		if (socketpair (AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+			throw generic_exception ("Could not create a socket pair for a worker");
+
+		pid_t pid = fork ();
+		if (pid < 0)
+			throw generic_exception ("Could not fork a worker process");
+
+		if (pid == 0) {
+			// Worker: keep only its own end of its own socket
+			for (int i=0; i<mWorkers; i++)
+				close (mpWorkers[i].fd);
+			close (fds[0]);
+			if (pin && processors > 0) {
+				cpu_set_t cpus;
+				CPU_ZERO (&cpus);
+				CPU_SET (w % processors, &cpus);
+				sched_setaffinity (0, sizeof(cpus), &cpus);
+			}
+			serve (fds[1], task);
+			_exit (0);	// Never run the destructors of the master's objects
+		}
+
+		close (fds[1]);
+		mpWorkers[w].pid  = pid;
+		mpWorkers[w].fd   = fds[0];
+		mpWorkers[w].busy = false;
+		mpWorkers[w].retired = false;
+		mWorkers++;
+		mLive++;
+	}
+}
+
+EvaluationFarm::~EvaluationFarm ()
+{
+	// Closing the sockets tells the workers to exit
+	for (int w=0; w<mWorkers; w++)
+		if (!mpWorkers[w].retired)
+			close (mpWorkers[w].fd);
+	for (int w=0; w<mWorkers; w++)
+		if (!mpWorkers[w].retired)
+			waitpid (mpWorkers[w].pid, NULL, 0);
+	delete [] mpWorkers;
+	pthread_cond_destroy (&mFreed);
+	pthread_mutex_destroy (&mMutex);
+}
+
+/*******************************************************************************
+ * The main loop of a worker process: evaluates requests until the
+ * master closes the socket.
+ ******************************************************************************/
+void EvaluationFarm::serve (int fd, FarmTask& task)
+{
+	char* buffer = NULL;
+	long capacity = 0;
+
+	Request request;
+	while (readFully (fd, &request, sizeof(request))) {
+		if (request.length > capacity) {
+			delete [] buffer;
+			capacity = request.length;
+			buffer = new char [capacity];
+		}
+		if (!readFully (fd, buffer, request.length))
+			break;
+
+		Reply reply;
+		reply.id     = request.id;
+		reply.failed = 0;
+		reply.result = 0.0;
+		try {
+			reply.result = task.evaluate (buffer, request.length);
+		} catch (...) {
+			reply.failed = 1;
+		}
+		if (!writeFully (fd, &reply, sizeof(reply)))
+			break;
+	}
+	delete [] buffer;
+	close (fd);
+}
+
+void EvaluationFarm::send (Worker& worker, int id, const void* data, long length)
+{
+	Request request;
+	request.id       = id;
+	request.reserved = 0;
+	request.length   = length;
+	if (!writeFully (worker.fd, &request, sizeof(request))
+		|| !writeFully (worker.fd, data, length))
+		throw generic_exception (format ("Worker process %d has died", int (worker.pid)));
+}
+
+EvaluationFarm::Reply EvaluationFarm::receive (Worker& worker)
+{
+	Reply reply;
+	if (!readFully (worker.fd, &reply, sizeof(reply)))
+		throw generic_exception (format ("Worker process %d has died", int (worker.pid)));
+	return reply;
+}
+
+/*******************************************************************************
+ * Stops a worker whose connection can no longer be trusted and
+ * reaps it. The worker must be reserved by the caller.
+ ******************************************************************************/
+void EvaluationFarm::retire (Worker& worker)
+{
+	close (worker.fd);
+	kill (worker.pid, SIGKILL);
+	waitpid (worker.pid, NULL, 0);
+}
+
+double EvaluationFarm::evaluate (const void* data, long length)
+{
+	// Reserve a free worker
+	pthread_mutex_lock (&mMutex);
+	Worker* worker = NULL;
+	while (!worker) {
+		if (mLive == 0) {
+			pthread_mutex_unlock (&mMutex);
+			throw generic_exception ("All the worker processes have died");
+		}
+		for (int w=0; w<mWorkers && !worker; w++)
+			if (!mpWorkers[w].busy && !mpWorkers[w].retired)
+				worker = &mpWorkers[w];
+		if (!worker)
+			pthread_cond_wait (&mFreed, &mMutex);
+	}
+	worker->busy = true;
+	pthread_mutex_unlock (&mMutex);
+
+	double result = 0.0;
+	String error;
+	bool lost = false;
+	try {
+		send (*worker, 0, data, length);
+		Reply reply = receive (*worker);
+		if (reply.failed)
+			error = format ("Evaluation failed in worker process %d", int (worker->pid));
+		result = reply.result;
+	} catch (generic_exception& e) {
+		// The request or the reply may have been cut, so the worker
+		// can't be used any more
+		error = e.what ();
+		lost = true;
+		retire (*worker);
+	}
+
+	pthread_mutex_lock (&mMutex);
+	worker->busy = false;
+	if (lost) {
+		worker->retired = true;
+		mLive--;
+		pthread_cond_broadcast (&mFreed); // Waiters may have to give up
+	} else
+		pthread_cond_signal (&mFreed);
+	pthread_mutex_unlock (&mMutex);
+
+	if (error.length () > 0)
+		throw generic_exception (error);
+	return result;
+}
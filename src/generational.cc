@@ -0,0 +1,340 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#include <magic/mclass.h>
+#include <magic/mtextstream.h>
+#include <nhp/individual.h>
+#include <annalee/learningenv.h>
+#include <annalee/neat.h>
+#include <annalee/neatspecies.h>
+#include <annalee/randomstream.h>
+#include <annalee/arena.h>
+#include <annalee/generational.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//   ___                                  o                  |  -----   _   //
+//  /   \  ___   _     ___       ___   |          _     ___  |  |      / \  //
+//  | __  /   ) |/ \  /   ) |/\  ___| -+- |  __  |/ \   ___| |  |---  /   \ //
+//  |   | |---  |   | |---  |   (   |  |  | /  \ |   | (   | |  |     |---| //
+//  \___/  \__  |   |  \__  |    \__|   \ | \__/ |   |  \__| |  |____ |   | //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+GenerationalEA::GenerationalEA (LearningEAEnv& env, const StringMap& params)
+		: mrEnv (env), mpSpeciation (NULL), mSpeciated (false), mMembers (0), mEvaluated (0),
+		  mEvaluations (0), mBest (-1)
+{
+	mSize           = getOrDefault (params, "GenerationalEA.size", String(50)).toInt ();
+	mMaxGenerations = getOrDefault (params, "GenerationalEA.maxGenerations", String(100)).toInt ();
+	mElites         = getOrDefault (params, "GenerationalEA.elites", String(1)).toInt ();
+	mTournament     = getOrDefault (params, "GenerationalEA.tournament", String(3)).toInt ();
+	mCrossover      = getOrDefault (params, "GenerationalEA.crossover", String(0.5)).toDouble ();
+	mMutationRate   = getOrDefault (params, "GenerationalEA.mutationRate", String(0.1)).toDouble ();
+
+	if (mSize < 2)
+		throw generic_exception (format ("GenerationalEA: population size %d is too small", mSize));
+	if (mElites < 1)
+		mElites = 1;
+	if (mElites >= mSize)
+		mElites = mSize-1;
+	if (mTournament < 1)
+		mTournament = 1;
+
+	mpPopulation = new Individual* [mSize];
+	mpFitness = new double [mSize];
+	mpShared = new double [mSize];
+	if (getOrDefault (params, "GenerationalEA.speciation", String(1)).toInt ())
+		mpSpeciation = new NEATSpeciation (params);
+
+	if (mrEnv.restored ())
+		restore (*mrEnv.restored ());
+	mrEnv.setCheckpointSource (this);
+}
+
+GenerationalEA::~GenerationalEA ()
+{
+	mrEnv.setCheckpointSource (NULL);
+	for (int i=0; i<mMembers; i++)
+		delete mpPopulation[i];
+	delete [] mpPopulation;
+	delete [] mpFitness;
+	delete [] mpShared;
+	delete mpSpeciation;
+}
+
+double GenerationalEA::bestFitness () const
+{
+	return (mBest >= 0)? mpFitness[mBest] : 0.0;
+}
+
+int GenerationalEA::species () const
+{
+	return mSpeciated? mpSpeciation->species () : 0;
+}
+
+/*******************************************************************************
+ * Runs the generation cycle: evaluates the members that have not been
+ * evaluated yet, reports the champion and breeds the next generation.
+ * A population restored from a checkpoint has already been evaluated
+ * and reported, so the cycle continues from the breeding.
+ ******************************************************************************/
+void GenerationalEA::evolve (OStream& log, OStream& out)
+{
+	if (mMembers == 0)
+		initialize ();
+
+	while (true) {
+		if (mEvaluated < mMembers) {
+			mrEnv.evaluateAll (mpPopulation+mEvaluated, mMembers-mEvaluated,
+							   mpFitness+mEvaluated);
+			mEvaluations += mMembers-mEvaluated;
+			mEvaluated = mMembers;
+			findBest ();
+
+			mrEnv.setChampion (mpPopulation[mBest]);
+			mrEnv.cycle_report (log, out);
+		}
+
+		if (mrEnv.generation () >= mMaxGenerations)
+			break;
+		breed ();
+	}
+}
+
+/*******************************************************************************
+ * Creates a random population, each individual with its own random
+ * stream.
+ ******************************************************************************/
+void GenerationalEA::initialize ()
+{
+	for (; mMembers<mSize; mMembers++) {
+		RandomKey key;
+		key.seed       = mrEnv.seed ();
+		key.generation = mrEnv.generation ();
+		key.individual = mMembers;
+		key.purpose    = RandomStream::INITIALIZATION;
+		RandomContext context (key);
+
+		Individual* ind = new Individual ();
+		mrEnv.addFeaturesTo (*ind);
+		ind->init ();
+		mpPopulation[mMembers] = ind;
+		Arena::current ().reset ();
+	}
+	mEvaluated = 0;
+}
+
+/*******************************************************************************
+ * Replaces the population with the next generation. The elites are
+ * moved to the front of the population as they are; the rest of the
+ * members are offspring of the previous generation, which is deleted
+ * once they have been bred.
+ ******************************************************************************/
+void GenerationalEA::breed ()
+{
+	shareFitness ();
+
+	Individual** next = new Individual* [mSize];
+	double* nextFitness = new double [mSize];
+	bool* kept = new bool [mMembers];
+	for (int i=0; i<mMembers; i++)
+		kept[i] = false;
+
+	// The best members, the champion first
+	int elites = (mElites < mMembers)? mElites : mMembers;
+	for (int e=0; e<elites; e++) {
+		int best = -1;
+		for (int i=0; i<mMembers; i++)
+			if (!kept[i] && (best < 0 || mpFitness[i] < mpFitness[best]))
+				best = i;
+		kept[best] = true;
+		next[e] = mpPopulation[best];
+		nextFitness[e] = mpFitness[best];
+	}
+
+	for (int i=elites; i<mSize; i++)
+		next[i] = NULL;
+	try {
+		for (int i=elites; i<mSize; i++) {
+			RandomKey key;
+			key.seed       = mrEnv.seed ();
+			key.generation = mrEnv.generation ();
+			key.individual = i;
+
+			key.purpose = RandomStream::SELECTION;
+			Individual* child;
+			{
+				RandomContext context (key);
+				child = next[i] = offspring ();
+			}
+			{
+				key.purpose = RandomStream::VARIATION;
+				RandomContext context (key);
+				child->pointMutate (MutationRate (mMutationRate));
+			}
+			{
+				key.purpose = RandomStream::DECODING;
+				RandomContext context (key);
+				child->getGene ("brainplan")->execute (GeneticMsg ("brainplan", *child));
+			}
+			Arena::current ().reset ();
+		}
+	} catch (...) {
+		for (int i=elites; i<mSize; i++)
+			delete next[i];
+		delete [] next;
+		delete [] nextFitness;
+		delete [] kept;
+		throw;
+	}
+
+	for (int i=0; i<mMembers; i++)
+		if (!kept[i])
+			delete mpPopulation[i];
+	delete [] kept;
+	delete [] mpPopulation;
+	delete [] mpFitness;
+	mpPopulation = next;
+	mpFitness    = nextFitness;
+	mMembers     = mSize;
+	mEvaluated   = elites;
+	mBest        = 0;
+}
+
+/*******************************************************************************
+ * Produces an unevaluated offspring from tournament-selected parents
+ * of the current generation.
+ ******************************************************************************/
+Individual* GenerationalEA::offspring () const
+{
+	int first = tournament ();
+	Individual* child = static_cast<Individual*> (mpPopulation[first]->replicate ());
+
+	if (streamFrnd() < mCrossover) {
+		int second = tournament ();
+		const NEATEncoding* a = dynamic_cast<const NEATEncoding*> (mpPopulation[first]->getGene ("brainplan"));
+		const NEATEncoding* b = dynamic_cast<const NEATEncoding*> (mpPopulation[second]->getGene ("brainplan"));
+		NEATEncoding* plan = dynamic_cast<NEATEncoding*> (const_cast<Genstruct*> (child->getGene ("brainplan")));
+		if (second != first && plan && a && b) {
+			if (mpFitness[second] < mpFitness[first])
+				plan->crossover (*b, *a);
+			else
+				plan->crossover (*a, *b);
+		}
+	}
+
+	return child;
+}
+
+/*******************************************************************************
+ * Computes the fitness values that the tournaments compare. The
+ * species are kept between the generations, so that their
+ * representatives are members of the previous generation.
+ ******************************************************************************/
+void GenerationalEA::shareFitness ()
+{
+	const NEATGenome** genomes = new const NEATGenome* [mMembers];
+	mSpeciated = mpSpeciation != NULL;
+	for (int i=0; i<mMembers && mSpeciated; i++) {
+		const NEATEncoding* plan = dynamic_cast<const NEATEncoding*> (mpPopulation[i]->getGene ("brainplan"));
+		if (plan)
+			genomes[i] = &plan->genome ();
+		else
+			mSpeciated = false;
+	}
+
+	if (mSpeciated) {
+		// The speciation has a random stream of its own
+		RandomKey key;
+		key.seed       = mrEnv.seed ();
+		key.generation = mrEnv.generation ();
+		key.individual = -1;
+		key.purpose    = RandomStream::SELECTION;
+		RandomContext context (key);
+
+		int* species = new int [mMembers];
+		mpSpeciation->speciate (genomes, mMembers, species);
+		for (int i=0; i<mMembers; i++)
+			mpShared[i] = mpFitness[i] * mpSpeciation->members (species[i]);
+		delete [] species;
+	} else
+		for (int i=0; i<mMembers; i++)
+			mpShared[i] = mpFitness[i];
+	delete [] genomes;
+}
+
+/** Returns the index of the best of randomly chosen members. */
+int GenerationalEA::tournament () const
+{
+	int winner = streamRnd (mMembers);
+	for (int i=1; i<mTournament; i++) {
+		int candidate = streamRnd (mMembers);
+		if (mpShared[candidate] < mpShared[winner])
+			winner = candidate;
+	}
+	return winner;
+}
+
+void GenerationalEA::findBest ()
+{
+	mBest = 0;
+	for (int i=1; i<mMembers; i++)
+		if (mpFitness[i] < mpFitness[mBest])
+			mBest = i;
+}
+
+/** Counters of the evolution in a checkpoint. */
+struct GenerationalState {
+	int				evaluations;
+};
+
+/*******************************************************************************
+ * The checkpoints are written in the reports, when the whole
+ * population has been evaluated.
+ ******************************************************************************/
+void GenerationalEA::addCheckpointSections (CheckpointWriter& writer)
+{
+	mrEnv.addGenomes (writer, "pop", mpPopulation, mpFitness, mEvaluated);
+
+	GenerationalState* state = (GenerationalState*) writer.reserve ("gea", sizeof(GenerationalState));
+	state->evaluations = mEvaluations;
+}
+
+/*******************************************************************************
+ * Continues from the evaluated population of a checkpoint.
+ ******************************************************************************/
+void GenerationalEA::restore (const Checkpoint& checkpoint)
+{
+	long size;
+	const GenerationalState* state = (const GenerationalState*) checkpoint.section ("gea", &size);
+	if (!state || size != sizeof(GenerationalState))
+		return;
+
+	mMembers = mrEnv.restoreGenomes (checkpoint, "pop", mpPopulation, mpFitness, mSize);
+	mEvaluated = mMembers;
+	if (mMembers > 0) {
+		mEvaluations = state->evaluations;
+		findBest ();
+	}
+}
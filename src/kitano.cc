@@ -27,6 +27,8 @@
 #include <inanna/initializer.h>
 #include <nhp/individual.h>
 #include "annalee/kitano.h"
+#include "annalee/randomstream.h"
+#include "annalee/arena.h"
 
 impl_dynamic (KitanoEncoding, {Gentainer});
 
@@ -116,7 +118,7 @@ bool KitanoEncoding::execute (const GeneticMsg& msg) const
 	PackTable<int> axiom (1,1);
 	axiom.get (0,0) = 16; // 16 means the first nonterminal
 
-	// Decode nonterminals recursively
+	// Decode nonterminals
 	PackTable<int>* connmat = decodeMatrix (axiom, rules, mIters);
 
 	// Calculate some statistics (probability of connection)
@@ -134,7 +136,7 @@ bool KitanoEncoding::execute (const GeneticMsg& msg) const
 	ANNetwork* net = makeNet (*connmat);
 
 	if (net) {
-		net->setInitializer (new GaussianInitializer (0.5));
+		net->setInitializer (new StreamInitializer (0.5));
 		
 		// Take baby pictures only if this is a picture-taking recreation
 		bool takePics = dynamic_cast<const TakeBrainPicsMsg*>(&msg) != NULL;
@@ -162,45 +164,63 @@ bool KitanoEncoding::execute (const GeneticMsg& msg) const
 	return true;
 }
 
+/*******************************************************************************
+ * Rewrites the matrix l times with the rules. Each rewrite replaces
+ * every nonterminal with a 2x2 block of symbols.
+ *
+ * The intermediate matrices are kept in the arena of the thread, so
+ * that only the final matrix is allocated from the heap.
+ ******************************************************************************/
 PackTable<int>* KitanoEncoding::decodeMatrix (const PackTable<int>& string, const PackTable<int>& rules, int l) const
 {
-
-	// Create a table to place the results of the next production
-	PackTable<int>* nextString = new PackTable<int> (string.rows*2, string.cols*2);
-
-	// Iterate through nonterminal matrix
-	for (int i=0; i<string.rows; i++)
-		for (int j=0; j<string.cols; j++) {
-			// Decode a value in the matrix
-			int k = string.get (i,j);
-			
-			// For nonterminals
-			nextString->get (i*2  ,j*2  ) = (k<0)? k : rules.get (k, 0);
-			nextString->get (i*2+1,j*2  ) = (k<0)? k : rules.get (k, 1);
-			nextString->get (i*2  ,j*2+1) = (k<0)? k : rules.get (k, 2);
-			nextString->get (i*2+1,j*2+1) = (k<0)? k : rules.get (k, 3);
-		}
-	
-	// Recurse
-	if (l>1) {
-		PackTable<int>* retval = decodeMatrix (*nextString, rules, l-1);
-		delete nextString;
-		return retval;
-	} else  {
-		// Convert the temporary values to final
-		for (int i=0; i<nextString->rows; i++)
-			for (int j=0; j<nextString->cols; j++) {
-				int& value = nextString->get(i,j);
-				switch (value) {
-				  case FINALONE:	value=1; break;
-				  case FINALZERO:	value=0; break;
-				  case VOIDAREA:	value=VOIDAREA; break;
-				  default: 			value=UNRESOLVED; // Unresolved
-				};
+	ArenaFrame frame;
+	const int levels = (l>1)? l : 1;
+
+	int rows = string.rows;
+	int cols = string.cols;
+	int* current = frame.arena().allocate<int> (long(rows)*cols);
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++)
+			current[i*cols+j] = string.get (i,j);
+
+	for (int level=0; level<levels; level++) {
+		// Create a matrix to place the results of the next production
+		int* next = frame.arena().allocate<int> (long(rows)*cols*4);
+		const int nextCols = cols*2;
+
+		// Iterate through nonterminal matrix
+		for (int i=0; i<rows; i++)
+			for (int j=0; j<cols; j++) {
+				// Decode a value in the matrix
+				int k = current[i*cols+j];
+
+				// For nonterminals
+				next[(i*2  )*nextCols + j*2  ] = (k<0)? k : rules.get (k, 0);
+				next[(i*2+1)*nextCols + j*2  ] = (k<0)? k : rules.get (k, 1);
+				next[(i*2  )*nextCols + j*2+1] = (k<0)? k : rules.get (k, 2);
+				next[(i*2+1)*nextCols + j*2+1] = (k<0)? k : rules.get (k, 3);
 			}
-		
-		return nextString;
+
+		current = next;
+		rows *= 2;
+		cols  = nextCols;
 	}
+
+	// Convert the temporary values to final
+	PackTable<int>* result = new PackTable<int> (rows, cols);
+	for (int i=0; i<rows; i++)
+		for (int j=0; j<cols; j++) {
+			int value = current[i*cols+j];
+			switch (value) {
+			  case FINALONE:	value=1; break;
+			  case FINALZERO:	value=0; break;
+			  case VOIDAREA:	value=VOIDAREA; break;
+			  default: 			value=UNRESOLVED; // Unresolved
+			};
+			result->get(i,j) = value;
+		}
+
+	return result;
 }
 
 ANNetwork* KitanoEncoding::makeNet (const PackTable<int>& connmatPar) const {
@@ -240,7 +260,7 @@ ANNetwork* KitanoEncoding::makeNet (const PackTable<int>& connmatPar) const {
 
 		// Set the position of the unit
 		if (i>=mInputs)
-			(*net)[i].moveTo (double(i-mInputs)/hiddens*10+5, 20*frnd(), 20*frnd());
+			(*net)[i].moveTo (double(i-mInputs)/hiddens*10+5, 20*streamFrnd(), 20*streamFrnd());
 
 		// Disable unit if 0 at diagonal
 		if (connmat.get(i,i)!=1) {
@@ -22,6 +22,8 @@
  *                                                                         *
  ***************************************************************************/
 
+#include <stdlib.h>
+#include <string.h>
 #include <magic/mmap.h>
 #include <magic/mclass.h>
 #include <magic/mtextstream.h>
@@ -38,10 +40,47 @@
 #include "annalee/miller.h"
 #include "annalee/cangelosi.h"
 #include "annalee/kitano.h"
+#include "annalee/neat.h"
+#include "annalee/neatnetwork.h"
+#include "annalee/substrate.h"
+#include "annalee/checkpoint.h"
+#include "annalee/brainfile.h"
+#include "annalee/asyncwriter.h"
+#include "annalee/evalfarm.h"
+#include "annalee/workstealer.h"
+#include "annalee/randomstream.h"
+#include "annalee/arena.h"
 //#include "chaosenc.h"
 
 impl_dynamic (LearningEAEnv, {EAEnvironment});
 
+/*******************************************************************************
+ * Trains and tests the networks sent to the worker processes of the
+ * evaluation farm, in the binary brain format. The network is
+ * preceded by the key of the random stream of the evaluation.
+ ******************************************************************************/
+class LearningFarmTask : public FarmTask {
+  public:
+						LearningFarmTask	(const LearningEAEnv& env) : mrEnv (env) {}
+
+	virtual double		evaluate			(const void* data, long length) {
+		if (length < long (sizeof(RandomKey)))
+			throw generic_exception ("Truncated evaluation request");
+		RandomContext context (*static_cast<const RandomKey*> (data));
+		BrainFile image (static_cast<const char*> (data) + sizeof(RandomKey),
+						 length - sizeof(RandomKey));
+		ANNetwork* brainplan = image.toNetwork ();
+		ANNetwork* brain = mrEnv.trainBrain (*brainplan);
+		double mse = brain->test (mrEnv.mEvaluationSet);
+		delete brain;
+		delete brainplan;
+		return mse;
+	}
+
+  private:
+	const LearningEAEnv&	mrEnv;
+};
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -65,7 +104,17 @@ LearningEAEnv::LearningEAEnv () :
 		mTrainSet ((PatternSet&) *new PatternSet()),
 		mEvaluationSet ((PatternSet&) *new PatternSet()),
 		mReportSet ((PatternSet&) *new PatternSet()),
-		mParams((StringMap&) *new StringMap())
+		mParams((StringMap&) *new StringMap()),
+		mpRestored (NULL),
+		mpRestoredBest (NULL),
+		mpCheckpointSource (NULL),
+		mpWriter (NULL),
+		mpChampionPlan (NULL),
+		mpChampionNet (NULL),
+		mChampionRecurrent (false),
+		mDeferStats (false),
+		mpFarmTask (NULL),
+		mpFarm (NULL)
 {
 	FORBIDDEN; // But IT'S NEVER CALLED! (whew...)
 }
@@ -83,7 +132,7 @@ LearningEAEnv::LearningEAEnv () :
  *
  *  @param params Dynamic parameter map.
  *	@param params["evals"] - Minimum number of evaluations per individual per generation [Default=1]
- *	@param params["encoding"] - The name of the encoding method to be used: layered, miller, kitano, nolfi, cangelosi [No default - required]
+ *	@param params["encoding"] - The name of the encoding method to be used: layered, miller, kitano, nolfi, cangelosi, neat, substrate [No default - required]
  *  @param params["noise"] - Amount of artificial noise to be added [Default=0]
  *	@param params["permutate"] - Should we permutate the training and evaluation sets during evolution? [Default=0 (no)]
  *	@param params["evalPart"] - Portion of EA evaluation set as a fraction [Default=0.333]
@@ -93,6 +142,16 @@ LearningEAEnv::LearningEAEnv () :
  *	@param params["termPart"] - Termination set portion of training set as a fraction [Default=0.25]
  *	@param params["logDir"] - Logging directory [Default="log"]
  *	@param params["optParams"] - Should the learning parameters be optimized by evolution? [Default=0 (no)]
+ *	@param params["checkpoint"] - Checkpoint file; the run is resumed from it if it exists. Only the encodings that can be packed, NEAT and its substrate, can be checkpointed. [Default="" (no checkpoints)]
+ *	@param params["checkpointInterval"] - Generations between checkpoints [Default=10]
+ *	@param params["brainFormat"] - Format of the saved best network: text, binary or both [Default="text"]
+ *	@param params["writeQueue"] - Length of the queue of the background writer of the reports, 0 to write synchronously [Default=16]
+ *	@param params["pictureInterval"] - Generations between the pictures of the champion, 0 for none [Default=1]
+ *	@param params["workers"] - Number of worker processes for training and evaluating the individuals, 0 to evaluate in this process. The workers are kept busy by the batches of @ref evaluateAll, as with @ref GenerationalEA, or by the threads of @ref SteadyStateEA; the SimplePopulation of nhp evaluates one individual at a time. [Default=0]
+ *	@param params["pinWorkers"] - Pin the worker processes to separate processors? [Default=0 (no)]
+ *	@param params["seed"] - Seed of the random streams of the individuals; with @ref GenerationalEA the same seed gives the same run with any number of threads or workers. The SimplePopulation of nhp initializes and mutates with the global generator. [Default=from rand()]
+ *	@param params["threads"] - Number of threads of @ref evaluateAll without worker processes, 0 for the number of processors [Default=0]
+ *	@param params["pictureDetail"] - "all" to decode the champion again for the encoding-specific pictures, "network" for the network pictures only [Default="network"]
  ******************************************************************************/
 LearningEAEnv::LearningEAEnv (const PatternSet& trainSet,
 							  const PatternSet& evalSet,
@@ -101,8 +160,24 @@ LearningEAEnv::LearningEAEnv (const PatternSet& trainSet,
 		: mTrainSet      (dynamic_cast<const PatternSet&>(trainSet)),
 		  mEvaluationSet (dynamic_cast<const PatternSet&>(evalSet)),
 		  mReportSet     (dynamic_cast<const PatternSet&>(testSet)),
-		  mParams        (params)
+		  mParams        (params),
+		  mGeneration    (0),
+		  mpRestored     (NULL),
+		  mpRestoredBest (NULL),
+		  mpCheckpointSource (NULL),
+		  mpWriter       (NULL),
+		  mpChampionPlan (NULL),
+		  mpChampionNet  (NULL),
+		  mChampionRecurrent (false),
+		  mDeferStats    (false),
+		  mpFarmTask     (NULL),
+		  mpFarm         (NULL)
 {
+	mTrained.brain = NULL;
+	mTrained.generation = -1;
+	pthread_mutex_init (&mTrainedMutex, NULL);
+	pthread_mutex_init (&mOutputMutex, NULL);
+
 	ASSERTWITH (trainSet.patterns>0, "Must have train patterns");
 	ASSERTWITH (evalSet.patterns>0, "Must have evaluation patterns");
 	
@@ -115,6 +190,16 @@ LearningEAEnv::LearningEAEnv (const PatternSet& trainSet,
 	mValidInterval	= getOrDefault (mParams, "LearningEAEnv.stripLen", String(10)).toInt ();
 	mTermMethod		= getOrDefault (mParams, "LearningEAEnv.terminator", String("GL5"));
 	mTermPart		= getOrDefault (mParams, "LearningEAEnv.termPart", String(0.25)).toInt ();
+	mCheckpointFile	= getOrDefault (mParams, "LearningEAEnv.checkpoint", String(""));
+	mCheckpointInterval = getOrDefault (mParams, "LearningEAEnv.checkpointInterval", String(10)).toInt ();
+	String encoding = getOrDefault (mParams, "LearningEAEnv.encoding", String(""));
+	if (!mCheckpointFile.isEmpty () && encoding != "neat" && encoding != "substrate")
+		throw generic_exception (format ("The %s encoding can not be checkpointed",
+										 (CONSTR) encoding));
+	mBrainFormat	= getOrDefault (mParams, "LearningEAEnv.brainFormat", String("text"));
+	mPictureInterval = getOrDefault (mParams, "LearningEAEnv.pictureInterval", String(1)).toInt ();
+	mPictureDetail	= getOrDefault (mParams, "LearningEAEnv.pictureDetail", String("network"));
+	mSeed			= (unsigned int) getOrDefault (mParams, "LearningEAEnv.seed", String(rand ())).toInt ();
 	logDir (getOrDefault (params, "logdir", String("log")));
 
 	mEvalPart		= evalSet.patterns/double(evalSet.patterns+trainSet.patterns);
@@ -137,8 +222,122 @@ LearningEAEnv::LearningEAEnv (const PatternSet& trainSet,
 	ASSERT (mTrainSet.patterns>0);
 	ASSERT (mEvaluationSet.patterns>0);
 	ASSERT (mReportSet.patterns>0);
+
+	// Resume an interrupted run
+	if (!mCheckpointFile.isEmpty () && Checkpoint::exists (mCheckpointFile)) {
+		mpRestored = new Checkpoint (mCheckpointFile);
+		restoreCheckpoint (*mpRestored);
+	}
+
+	// The workers are forked last, so that they get the final datasets
+	int workers = getOrDefault (mParams, "LearningEAEnv.workers", String(0)).toInt ();
+	if (workers > 0) {
+		mpFarmTask = new LearningFarmTask (*this);
+		mpFarm = new EvaluationFarm (workers, *mpFarmTask,
+									 getOrDefault (mParams, "LearningEAEnv.pinWorkers", String(0)).toInt ());
+	}
+
+	// The writer thread is started only after the fork, so that the
+	// workers are not forked while it holds a lock
+	mpWriter = new AsyncWriter (getOrDefault (mParams, "LearningEAEnv.writeQueue", String(16)).toInt ());
 }
 
+LearningEAEnv::~LearningEAEnv ()
+{
+	delete mpFarm;
+	delete mpFarmTask;
+	delete mpWriter; // Flushes the pending reports
+	delete mpChampionPlan;
+	delete mpChampionNet;
+	delete mpRestored;
+	delete mpRestoredBest;
+	clearTrained ();
+	pthread_mutex_destroy (&mTrainedMutex);
+	pthread_mutex_destroy (&mOutputMutex);
+}
+
+/*******************************************************************************
+ * Background job that saves a copy of the best network.
+ ******************************************************************************/
+class SaveBrainJob : public AsyncJob {
+  public:
+						SaveBrainJob	(const ANNetwork& brain, const String& basename,
+										 const String& format, int inputs, int outputs)
+								: mpBrain (new ANNetwork (brain)), mBasename (basename),
+								  mFormat (format), mInputs (inputs), mOutputs (outputs) {}
+						~SaveBrainJob	() {delete mpBrain;}
+
+	virtual void		run				() {
+		if (mFormat != "binary")
+			ANNFileFormatLib::save (mBasename + ".net", *mpBrain);
+		if (mFormat != "text")
+			BrainFile::save (mBasename + ".brain", *mpBrain, mInputs, mOutputs);
+	}
+
+  private:
+	ANNetwork*			mpBrain;
+	String				mBasename;
+	String				mFormat;
+	int					mInputs, mOutputs;
+};
+
+/*******************************************************************************
+ * Background job that writes a collected checkpoint.
+ ******************************************************************************/
+class CheckpointJob : public AsyncJob {
+  public:
+						CheckpointJob	(CheckpointWriter* writer, const String& filename)
+								: mpWriter (writer), mFilename (filename) {}
+						~CheckpointJob	() {delete mpWriter;}
+
+	virtual void		run				() {mpWriter->write (mFilename);}
+
+  private:
+	CheckpointWriter*	mpWriter;
+	String				mFilename;
+};
+
+/** Files of the pictures of the champion, and the corresponding
+ *  features set by the encodings.
+ **/
+static const char* pictureFiles[] = {"/einstein-pic1.eps", "/einstein-pic2.eps",
+									 "/einstein-pic3.eps", "/einstein-desc1.txt"};
+static const char* pictureFeatures[] = {"brainpic1", "brainpic2", "brainpic3", "braindesc1"};
+
+/*******************************************************************************
+ * Background job that decodes a copy of the brainplan of the champion
+ * and writes its pictures. The encodings that can stream their
+ * largest pictures write them directly to the files.
+ ******************************************************************************/
+class DrawPicturesJob : public AsyncJob {
+  public:
+						DrawPicturesJob	(Genstruct* plan, const String& dir, int first,
+										 const RandomKey& key)
+								: mpPlan (plan), mDir (dir), mFirst (first), mKey (key) {}
+						~DrawPicturesJob	() {delete mpPlan;}
+
+	virtual void		run				() {
+		RandomContext context (mKey);
+		ArenaFrame frame;
+		Individual host;
+		mpPlan->execute (TakeBrainPicsMsg ("brainplan", host, mDir + "/einstein"));
+
+		// Check if any of these exists in the individual's properties
+		for (int p=mFirst; p<4; p++) {
+			const String& pic = static_cast<const String&> (host[pictureFeatures[p]]);
+			if (!isnull(pic))
+				// A property exists -> save it
+				FileWriteJob (mDir + pictureFiles[p], pic).run ();
+		}
+	}
+
+  private:
+	Genstruct*			mpPlan;
+	String				mDir;
+	int					mFirst;			// First picture to save
+	RandomKey			mKey;
+};
+
 /*******************************************************************************
  * Implementation for @ref EAEnvironment.
  ******************************************************************************/
@@ -161,6 +360,10 @@ void LearningEAEnv::addFeaturesTo (Genome& genome) const
 		genome.add (new CangelosiEncoding ("brainplan", mParams));
 	else if (encoding == "kitano")
 		genome.add (new KitanoEncoding ("brainplan", mParams));
+	else if (encoding == "neat")
+		genome.add (new NEATEncoding ("brainplan", mParams));
+	else if (encoding == "substrate")
+		genome.add (new SubstrateEncoding ("brainplan", mParams));
 	//	else if (encoding == "chaos")
 	//		genome.add (new ChaosEncoding ("brainplan", mParams));
 	else
@@ -218,10 +421,11 @@ double LearningEAEnv::evaluateg (const Individual& ind)
 	if (mPermutate)
 		permutate ();
 	
-	// Create a separate training set and GA evaluation set
-	PatternSet trainSet, terminSet;
-	trainSet.copy (mTrainSet, 0, int(mTrainSet.patterns*(1-mTermPart))-1);
-	terminSet.copy (mTrainSet, int(mTrainSet.patterns*(1-mTermPart)), mTrainSet.patterns-1);
+	// Recurrent NEAT phenotypes can't be trained with the feed-forward
+	// trainer, so they are evaluated with their evolved weights
+	const Object& neatbrain = ind["neatbrain"];
+	if (!isnull(neatbrain))
+		return dynamic_cast<const NEATNetwork&> (neatbrain).test (mEvaluationSet);
 
 	// Get the I/O interface of the individual and set the parameters
 	// which it doesn't know yet
@@ -229,24 +433,38 @@ double LearningEAEnv::evaluateg (const Individual& ind)
 	ASSERT (brainplan);
 	//io.logDir (mLogDir);
 
-	ANNetwork* brain = new ANNetwork (*brainplan);
+	// Measure the fitness of the network with several criteria
+	double fitn_MSE;
+	if (mpFarm) {
+		// Train and test with the evaluation set in a worker process,
+		// using the random stream of this evaluation
+		RandomKey key;
+		memset (&key, 0, sizeof(key));
+		if (const RandomStream* stream = RandomContext::current ())
+			key = stream->key ();
 
-	Trainer* pTrainer = createTrainer ();
+		long length;
+		char* image = BrainFile::pack (*brainplan, mTrainData.inputs, mTrainData.outputs, length);
+		char* request = new char [sizeof(RandomKey) + length];
+		memcpy (request, &key, sizeof(RandomKey));
+		memcpy (request + sizeof(RandomKey), image, length);
+		delete [] image;
+		try {
+			fitn_MSE = mpFarm->evaluate (request, sizeof(RandomKey) + length);
+		} catch (...) {
+			delete [] request;
+			throw;
+		}
+		delete [] request;
+	} else {
+		ANNetwork* brain = trainBrain (*brainplan);
 
-	// Train the individual for a while
-	double trainMSE = pTrainer->train (*brain,
-									  trainSet,
-									  mMaxTrainCycles,
-									  &terminSet,
-									  mValidInterval);
-	delete pTrainer;
-	trainMSE = 0.0; // Dispose. WARNING
+		// Test with evaluation set
+		fitn_MSE = brain->test (mEvaluationSet);
 
-	// Measure the fitness of the network with several criteria
-	
-	// Test with evaluation set
-	double fitn_MSE = brain->test (mEvaluationSet);
-	delete brain;
+		// Keep the trained network for the report, if this becomes the champion
+		keepTrained (ind, *brainplan, brain, fitn_MSE);
+	}
 
 	double fitn_conns	= 0;
 	double fitn_hiddens	= 0;
@@ -255,17 +473,229 @@ double LearningEAEnv::evaluateg (const Individual& ind)
 	// Collect the factors together
 	double fitness = fitn_MSE*1.0 + fitn_conns*0.0 + fitn_hiddens*0.0 + fitn_inputs*0.0;
 
-	// Print some stats
+	// Print some stats. The evaluations may run in parallel, so the
+	// line is printed at once, or by evaluateAll in the order of the
+	// individuals.
+	if (!mDeferStats) {
+		String line = statsLine (ind);
+		pthread_mutex_lock (&mOutputMutex);
+		sout.printf ("%s", (CONSTR) line);
+		pthread_mutex_unlock (&mOutputMutex);
+	}
+	
+	return fitness;
+}
+
+String LearningEAEnv::statsLine (const Individual& ind) const
+{
+	String line;
 	const Object& stats = ind["stats"];
 	if (!isnull(stats))
-		sout.printf (", stats=%s", (CONSTR) dynamic_cast<const String&>(stats));
+		line = format (", stats=%s", (CONSTR) dynamic_cast<const String&>(stats));
 	else
-		sout.printf (", stats=0 0");
+		line = ", stats=0 0";
 	const Object& pConn = ind["pConn"];
 	if (!isnull(pConn))
-		sout.printf (", pConn=%s", (CONSTR) dynamic_cast<const String&>(pConn));
-	
-	return fitness;
+		line += format (", pConn=%s", (CONSTR) dynamic_cast<const String&>(pConn));
+	return line;
+}
+
+int LearningEAEnv::workers () const
+{
+	return mpFarm? mpFarm->workers () : 0;
+}
+
+/*******************************************************************************
+ * Evaluation of the individuals of a generation as tasks of a @ref
+ * WorkStealer. The training time is roughly proportional to the size
+ * of the decoded network, so the cost of a task is estimated from
+ * the numbers of connections and units.
+ ******************************************************************************/
+class EvaluationTasks : public WorkTasks {
+  public:
+						EvaluationTasks	(LearningEAEnv& env, const Individual* const* individuals,
+										 double* fitness)
+								: mrEnv (env), mpIndividuals (individuals), mpFitness (fitness) {}
+
+	virtual double		cost			(int task) const {
+		const Object& neatbrain = (*mpIndividuals[task])["neatbrain"];
+		if (!isnull (neatbrain)) {
+			const NEATNetwork& brain = dynamic_cast<const NEATNetwork&> (neatbrain);
+			return brain.connections () + brain.units ();
+		}
+		const ANNetwork* net = dynamic_cast<const ANNetwork*> (mpIndividuals[task]->getFeature ("brainplan"));
+		if (!net)
+			return 1.0;
+		double edges = 0;
+		for (int i=0; i<net->size (); i++)
+			edges += (*net)[i].incomings ();
+		return edges + net->size ();
+	}
+
+	virtual void		run				(int task) {
+		RandomKey key;
+		key.seed       = mrEnv.seed ();
+		key.generation = mrEnv.generation ();
+		key.individual = task;
+		key.purpose    = RandomStream::TRAINING;
+		RandomContext context (key);
+		mpFitness[task] = mrEnv.evaluateg (*mpIndividuals[task]);
+		Arena::current ().reset ();
+	}
+
+  private:
+	LearningEAEnv&			mrEnv;
+	const Individual* const* mpIndividuals;
+	double*					mpFitness;
+};
+
+/*******************************************************************************
+ * Evaluates the individuals in parallel threads, largest networks
+ * first. With worker processes, there is one thread for each worker.
+ ******************************************************************************/
+void LearningEAEnv::evaluateAll (const Individual* const* individuals, int n, double* fitness)
+{
+	int threads = workers ();
+	if (threads == 0)
+		threads = getOrDefault (mParams, "LearningEAEnv.threads", String(0)).toInt ();
+
+	EvaluationTasks tasks (*this, individuals, fitness);
+	WorkStealer scheduler (threads);
+	mDeferStats = true;
+	try {
+		scheduler.run (tasks, n);
+	} catch (...) {
+		mDeferStats = false;
+		throw;
+	}
+	mDeferStats = false;
+
+	// The stats in the order of the individuals, not of completion
+	for (int i=0; i<n; i++)
+		sout.printf ("%s", (CONSTR) statsLine (*individuals[i]));
+}
+
+/*******************************************************************************
+ * Trains a copy of a network with the training set, using a part of
+ * the set for early termination.
+ *
+ * @return The trained network, to be deleted by the caller.
+ ******************************************************************************/
+ANNetwork* LearningEAEnv::trainBrain (const ANNetwork& brainplan) const
+{
+	// Create a separate training set and GA evaluation set
+	PatternSet trainSet, terminSet;
+	trainSet.copy (mTrainSet, 0, int(mTrainSet.patterns*(1-mTermPart))-1);
+	terminSet.copy (mTrainSet, int(mTrainSet.patterns*(1-mTermPart)), mTrainSet.patterns-1);
+
+	ANNetwork* brain = new ANNetwork (brainplan);
+
+	Trainer* pTrainer = createTrainer ();
+
+	// Train the individual for a while
+	pTrainer->train (*brain, trainSet, mMaxTrainCycles, &terminSet, mValidInterval);
+	delete pTrainer;
+
+	return brain;
+}
+
+/*******************************************************************************
+ * Hash of the decoded genome of an individual, that is, of the
+ * topology and the initial weights of its brainplan network. FNV-1a
+ * over the connections and biases of the units.
+ ******************************************************************************/
+static unsigned long long planHash (const ANNetwork& plan)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	for (int t=0; t<plan.size (); t++) {
+		const Neuron& neuron = plan[t];
+		double bias = neuron.bias ();
+		int incomings = neuron.incomings ();
+		const unsigned char* p = (const unsigned char*) &bias;
+		for (unsigned int b=0; b<sizeof(bias); b++)
+			hash = (hash ^ p[b]) * 1099511628211ULL;
+		hash = (hash ^ (unsigned int) incomings) * 1099511628211ULL;
+		for (int j=0; j<incomings; j++) {
+			int source = neuron.incoming(j).source().id ();
+			double weight = neuron.incoming(j).weight ();
+			hash = (hash ^ (unsigned int) source) * 1099511628211ULL;
+			p = (const unsigned char*) &weight;
+			for (unsigned int b=0; b<sizeof(weight); b++)
+				hash = (hash ^ p[b]) * 1099511628211ULL;
+		}
+	}
+	return hash;
+}
+
+/*******************************************************************************
+ * Stores the network trained for an individual if its fitness is
+ * better than that of the network in the cache, which is then
+ * deleted. Otherwise the given network is deleted. The cache takes
+ * the ownership of the network.
+ *
+ * The cache holds the fittest network of the current generation
+ * only; a network of an earlier generation is always replaced. The
+ * individuals are identified by the generation and their address
+ * together with the hash of their decoded genome, so that a new
+ * individual allocated at the address of a deleted one is not
+ * mistaken for it.
+ ******************************************************************************/
+void LearningEAEnv::keepTrained (const Individual& ind, const ANNetwork& brainplan,
+								 ANNetwork* brain, double fitness)
+{
+	int generation = this->generation ();
+	unsigned long long genome = planHash (brainplan);
+
+	pthread_mutex_lock (&mTrainedMutex);
+	if (mTrained.brain && mTrained.generation == generation && fitness >= mTrained.fitness) {
+		pthread_mutex_unlock (&mTrainedMutex);
+		delete brain;
+		return;
+	}
+	ANNetwork* old = mTrained.brain;
+	mTrained.generation = generation;
+	mTrained.individual = &ind;
+	mTrained.genome     = genome;
+	mTrained.brain      = brain;
+	mTrained.fitness    = fitness;
+	pthread_mutex_unlock (&mTrainedMutex);
+
+	delete old;
+}
+
+/*******************************************************************************
+ * Removes the trained network of an individual from the cache and
+ * returns it, or NULL if the network in the cache is not that of the
+ * individual evaluated in the given generation.
+ *
+ * @param fitness Set to the fitness the network was stored with.
+ ******************************************************************************/
+ANNetwork* LearningEAEnv::takeTrained (const Individual& ind, int generation, double& fitness)
+{
+	const ANNetwork* brainplan = dynamic_cast<const ANNetwork*> (ind.getFeature ("brainplan"));
+	if (!brainplan)
+		return NULL;
+	unsigned long long genome = planHash (*brainplan);
+	ANNetwork* result = NULL;
+
+	pthread_mutex_lock (&mTrainedMutex);
+	if (mTrained.brain && mTrained.generation == generation && mTrained.individual == &ind
+		&& mTrained.genome == genome) {
+		result  = mTrained.brain;
+		fitness = mTrained.fitness;
+		mTrained.brain = NULL;
+	}
+	pthread_mutex_unlock (&mTrainedMutex);
+
+	return result;
+}
+
+void LearningEAEnv::clearTrained ()
+{
+	pthread_mutex_lock (&mTrainedMutex);
+	delete mTrained.brain;
+	mTrained.brain = NULL;
+	pthread_mutex_unlock (&mTrainedMutex);
 }
 
 /*******************************************************************************
@@ -289,6 +719,15 @@ void LearningEAEnv::cycle_report (OStream& log, OStream& out) {
 	// Get the I/O interface of the individual
 	// best->execute (GeneticMsg ("IO", *best));
 	ASSERT (mpBest);
+
+	// Raise the errors of the earlier reports and checkpoints, which
+	// were written in the background
+	mpWriter->checkErrors ();
+
+	// Structural innovations are shared only within a generation
+	NEATEncoding::newGeneration ();
+	int reported = __sync_fetch_and_add (&mGeneration, 1);
+
 	/*
 	LearningIO& io = static_cast<LearningIO&> ((*best)["IO"]);
 
@@ -301,60 +740,69 @@ void LearningEAEnv::cycle_report (OStream& log, OStream& out) {
 	io.logDir (cycleLogDir);
 	*/
 	
-	// Create a separate training set and GA evaluation set
-	PatternSet trainSet, terminSet;
-	trainSet.copy (mTrainSet, 0, int(mTrainSet.patterns*(1-mTermPart))-1);
-	terminSet.copy (mTrainSet, int(mTrainSet.patterns*(1-mTermPart)),
-					mTrainSet.patterns-1);
-	
-	ANNetwork& brain = dynamic_cast <ANNetwork&> ((*mpBest)["brainplan"]);
-	
-	Trainer* pTrainer = createTrainer ();
-	
-	// Train the individual for a while
-	pTrainer->train (brain, trainSet, mMaxTrainCycles, &terminSet, mValidInterval);
-	
-	// Save this to a file
-	ANNFileFormatLib::save (mLogDir + "/einstein.net", brain);
-	//brain.saveBrain (mLogDir + "/einstein.net", "Best brain found by Annalee");
-	
-	// Save the pattern sets _only_ for the first cycle
-	/*
-	  if (mCycles==1) {
-	  trainSet.save (mLogDir+"/train.pat");
-	  terminSet.save (mLogDir+"/termin.pat");
-	  mEvaluationSet.save (mLogDir+"/eval.pat");
-	  ((PatternSet&)mReportSet).save (mLogDir+"/report.pat");
-	  }
-	*/
-	
 	// Excuse me, I'm looking for the Einstein Brain, can you tell me
 	// where I can find the Einstein Brain, please?
 	
 	// Test with each evaluation pattern while counting the correct
 	// predictions
+	double mse;
+	int failures = 0;
+	const Object& neatbrain = (*mpBest)["neatbrain"];
+	if (!isnull (neatbrain)) {
+		// A recurrent NEAT or substrate champion was evaluated with
+		// its evolved weights, so it is reported and saved as such
+		const NEATNetwork& brain = dynamic_cast<const NEATNetwork&> (neatbrain);
+		mse = brain.test (mReportSet, &failures);
+		mpWriter->write (mLogDir + "/einstein.neat", brain.toString ());
+	} else {
+		// Reuse the network that was trained when the champion was
+		// evaluated. It has to be trained here only if the champion
+		// was not trained in this process in the reported generation,
+		// as after a restart or when the evaluations are done by
+		// worker processes, or if a fitter individual was evaluated.
+		double fitness;
+		ANNetwork* trained = takeTrained (*mpBest, reported, fitness);
+		clearTrained ();
+		if (!trained)
+			trained = trainBrain (dynamic_cast <ANNetwork&> ((*mpBest)["brainplan"]));
+		ANNetwork& brain = *trained;
+	
+		// Save a copy of this to a file in the background
+		mpWriter->submit (new SaveBrainJob (brain, mLogDir + "/einstein", mBrainFormat,
+											mTrainData.inputs, mTrainData.outputs));
+		//brain.saveBrain (mLogDir + "/einstein.net", "Best brain found by Annalee");
+	
+		// Save the pattern sets _only_ for the first cycle
+		/*
+		  if (mCycles==1) {
+		  trainSet.save (mLogDir+"/train.pat");
+		  terminSet.save (mLogDir+"/termin.pat");
+		  mEvaluationSet.save (mLogDir+"/eval.pat");
+		  ((PatternSet&)mReportSet).save (mLogDir+"/report.pat");
+		  }
+		*/
+
+		if (mProblemType == CLASSIFICATION || mProblemType == CLASSIFICATION2) {
+			ClassifResults* clsresults = brain.testClassify (mReportSet);
+			mse = clsresults->mse;
+			failures = clsresults->failures;
+			delete clsresults;
+		} else
+			mse = brain.test (mReportSet);
+		delete trained;
+	}
+
 	switch (mProblemType) {
 	  case CLASSIFICATION:
 	  case CLASSIFICATION2: {
-		  //const ANNetwork& net = io.getNet ();
-		  if (!isnull (brain)) {
-			  ClassifResults* clsresults = brain.testClassify (mReportSet);
-			  double perc = double(clsresults->failures) / double(mReportSet.patterns);
-			  out.printf ("Number of incorrect predictions: "
-						  "%4d out of %4d (%0.2f%%), mse=%f\n",
-						  clsresults->failures, mReportSet.patterns, perc*100,
-						  clsresults->mse);
-			  log.printf ("%f %f", clsresults->mse, perc);
-			  delete clsresults;
-		  } else {
-			  out.printf ("Einstein is out of his mind. "
-						  "Propably his brain doesn't exist at all\n");
-			  log.printf ("666.0 666.0");
-		  }
+		  double perc = double(failures) / double(mReportSet.patterns);
+		  out.printf ("Number of incorrect predictions: "
+					  "%4d out of %4d (%0.2f%%), mse=%f\n",
+					  failures, mReportSet.patterns, perc*100, mse);
+		  log.printf ("%f %f", mse, perc);
 	  } break;
 	  
 	  case APPROXIMATION: {
-		  double mse = brain.test (mReportSet);
 		  out.printf ("MSE=%f", mse);
 	  } break;
 	  
@@ -365,24 +813,282 @@ void LearningEAEnv::cycle_report (OStream& log, OStream& out) {
 	log.flush ();
 	
 	// Print any network pictures to corresponding log files
-	
-	// Invoke the brainplan to make the network pictures
-	mpBest->execute (TakeBrainPicsMsg ("brainplan", *mpBest));
-	
-	// Check if any of these exists in the individual's properties
-	char pnames[][20]={"brainpic1","brainpic2","brainpic3","braindesc1"};
-	char fnames[][20]={"/einstein-pic1.eps","/einstein-pic2.eps",
-					   "/einstein-pic3.eps","/einstein-desc1.txt"};
-	for (int p=0; p<4; p++) {
-		const String& pic = static_cast<const String&> ((*mpBest)[pnames[p]]);
-		if (!isnull(pic)) {
-			// A property exists -> save it
-			FILE* fout = fopen (mLogDir + fnames[p], "w");
-			ASSERT (fout);
-			fprintf (fout, "%s", (CONSTR) pic);
-			fclose (fout);
+	rememberChampion ();
+	if (mPictureInterval > 0 && mGeneration % mPictureInterval == 0)
+		drawPictures (mLogDir, mPictureDetail == "all");
+
+	if (!mCheckpointFile.isEmpty () && mCheckpointInterval > 0
+		&& mGeneration % mCheckpointInterval == 0) {
+		// Don't checkpoint past a report that could not be written
+		mpWriter->flush ();
+		saveCheckpoint ();
+	}
+}
+
+/*******************************************************************************
+ * Stores copies of the brainplan gene and the decoded network of the
+ * champion, so that its pictures can be drawn later with @ref
+ * drawPictures. Copying is cheap compared to the decoding and
+ * drawing that is saved.
+ ******************************************************************************/
+void LearningEAEnv::rememberChampion ()
+{
+	delete mpChampionPlan;
+	delete mpChampionNet;
+	mpChampionPlan = mpBest->getGene ("brainplan")->replicate ();
+
+	// The network that was evaluated is drawn, with any recurrent
+	// connections
+	const Object& neatbrain = (*mpBest)["neatbrain"];
+	mChampionRecurrent = !isnull (neatbrain);
+	if (mChampionRecurrent) {
+		const NEATNetwork& brain = dynamic_cast<const NEATNetwork&> (neatbrain);
+		mpChampionNet = new ANNetwork (format ("%d-%d-%d", brain.inputs (),
+											   brain.units ()-brain.inputs ()-brain.outputs (),
+											   brain.outputs ()));
+		brain.connect (*mpChampionNet, true);
+	} else
+		mpChampionNet = new ANNetwork (dynamic_cast<const ANNetwork&> (*mpBest->getFeature ("brainplan")));
+}
+
+/*******************************************************************************
+ * Draws the pictures of the latest champion to the given directory.
+ *
+ * The pictures of the network topology are drawn from the network
+ * that was decoded for the evaluation. The encoding-specific pictures
+ * and descriptions require decoding the genome once more, so they are
+ * drawn only if requested, and in the background. For a champion
+ * that was evaluated as a recurrent network, only the description is
+ * taken from the encoding, as its pictures show the feed-forward part
+ * only.
+ *
+ * @param decode Decode the genome for the encoding-specific pictures.
+ ******************************************************************************/
+void LearningEAEnv::drawPictures (const String& dir, bool decode)
+{
+	if (!mpChampionPlan)
+		return;
+
+	if (decode) {
+		// The genome is decoded and the pictures drawn in the
+		// background, from a copy of the brainplan
+		RandomKey key;
+		key.seed       = mSeed;
+		key.generation = mGeneration;
+		key.individual = -1;
+		key.purpose    = RandomStream::DECODING;
+		mpWriter->submit (new DrawPicturesJob (mpChampionPlan->replicate (), dir,
+											   mChampionRecurrent? 3 : 0, key));
+	}
+
+	if (!decode || mChampionRecurrent) {
+		// The same pictures of the cleaned-up network as the
+		// encodings draw. The layered layout is only for
+		// feed-forward networks.
+		mpWriter->write (dir + pictureFiles[1], mpChampionNet->drawEPS ());
+		if (!mChampionRecurrent) {
+			ANNetwork layout (*mpChampionNet);
+			layout.drawFeedForward ();
+			mpWriter->write (dir + pictureFiles[2], layout.drawEPS ());
+		}
+	}
+}
+
+/** Fixed-size state of the environment in a checkpoint. */
+struct LearningEnvState {
+	int				generation;
+	unsigned int	seed;			// Seed of the random streams
+	int				problemType;
+	int				patterns;		// Size of the full training data
+	int				inputs;
+	int				outputs;
+	int				nextInnovation;	// NEAT innovation counters
+	int				nextNode;
+	double			evalPart;
+};
+
+/*******************************************************************************
+ * Writes a checkpoint of the run. The state is collected immediately,
+ * while the file is written by the background writer.
+ *
+ * The random streams of the individuals are determined by the seed
+ * of the run and the generation, so storing the seed is enough for
+ * a resumed run to continue with the same random sequences as the
+ * original run. The global generator of MagiC is not touched, so
+ * checkpointing does not change the course of the run. Numbers drawn
+ * from it outside of any random context can not be restored.
+ ******************************************************************************/
+void LearningEAEnv::saveCheckpoint ()
+{
+	CheckpointWriter* writer = new CheckpointWriter;
+	addCheckpointSections (*writer);
+	mpWriter->submit (new CheckpointJob (writer, mCheckpointFile));
+}
+
+void LearningEAEnv::addCheckpointSections (CheckpointWriter& writer)
+{
+	LearningEnvState* state = (LearningEnvState*) writer.reserve ("env", sizeof(LearningEnvState));
+	state->generation		= mGeneration;
+	state->seed				= mSeed;
+	state->problemType		= mProblemType;
+	state->patterns			= mTrainData.patterns;
+	state->inputs			= mTrainData.inputs;
+	state->outputs			= mTrainData.outputs;
+	state->nextInnovation	= NEATEncoding::innovations().nextInnovation ();
+	state->nextNode			= NEATEncoding::innovations().nextNode ();
+	state->evalPart			= mEvalPart;
+
+	// The training data in its current order, as it may have been
+	// permutated
+	const int width = mTrainData.inputs + mTrainData.outputs;
+	double* data = (double*) writer.reserve ("data", mTrainData.patterns*width*sizeof(double));
+	for (int p=0; p<mTrainData.patterns; p++) {
+		for (int i=0; i<mTrainData.inputs; i++)
+			*data++ = mTrainData.input (p, i);
+		for (int o=0; o<mTrainData.outputs; o++)
+			*data++ = mTrainData.output (p, o);
+	}
+
+	if (mpBest) {
+		const Individual* best = mpBest;
+		addGenomes (writer, "best", &best, NULL, 1);
+	}
+
+	if (mpCheckpointSource)
+		mpCheckpointSource->addCheckpointSections (writer);
+}
+
+void LearningEAEnv::restoreCheckpoint (const Checkpoint& checkpoint)
+{
+	long size;
+	const LearningEnvState* state = (const LearningEnvState*) checkpoint.section ("env", &size);
+	if (!state || size != sizeof(LearningEnvState))
+		throw generic_exception (format ("Checkpoint '%s' has no environment state",
+										 (CONSTR) mCheckpointFile));
+	if (state->patterns != mTrainData.patterns || state->inputs != mTrainData.inputs
+		|| state->outputs != mTrainData.outputs)
+		throw generic_exception (format ("Checkpoint '%s' is for a different dataset",
+										 (CONSTR) mCheckpointFile));
+
+	mGeneration  = state->generation;
+	mProblemType = state->problemType;
+	mEvalPart    = state->evalPart;
+	mSeed        = state->seed;
+	NEATEncoding::innovations().reserve (state->nextInnovation, state->nextNode);
+
+	const int width = mTrainData.inputs + mTrainData.outputs;
+	const double* data = (const double*) checkpoint.section ("data", &size);
+	ASSERTWITH (data && size == long (mTrainData.patterns*width*sizeof(double)),
+				"Truncated training data in checkpoint");
+	for (int p=0; p<mTrainData.patterns; p++) {
+		for (int i=0; i<mTrainData.inputs; i++)
+			mTrainData.set_input (p, i, *data++);
+		for (int o=0; o<mTrainData.outputs; o++)
+			mTrainData.set_output (p, o, *data++);
+	}
+	splitTrainData ();
+
+	// The champion is reported again if the driver does not find a
+	// better one
+	if (restoreGenomes (checkpoint, "best", &mpRestoredBest, NULL, 1) > 0) {
+		mpBest = mpRestoredBest;
+		rememberChampion ();
+	}
+}
+
+/** Header of a genome in a section written by addGenomes. */
+struct PackedGenome {
+	long long		size;			// Size of the packed encoding
+	double			fitness;
+};
+
+/*******************************************************************************
+ * The section begins with the number of genomes, and each packed
+ * encoding is preceded by a @ref PackedGenome header and padded to 8
+ * bytes, so that the genomes stay aligned.
+ ******************************************************************************/
+int LearningEAEnv::addGenomes (CheckpointWriter& writer, const char* tag,
+							   const Individual* const* individuals,
+							   const double* fitness, int n) const
+{
+	const ANNEncoding** plans = new const ANNEncoding* [n];
+	long total = sizeof(long long);
+	for (int i=0; i<n; i++) {
+		plans[i] = dynamic_cast<const ANNEncoding*> (individuals[i]->getGene ("brainplan"));
+		if (!plans[i] || plans[i]->packedSize () < 0) {
+			delete [] plans;
+			throw generic_exception (format ("The %s encoding can not be checkpointed",
+											 (CONSTR) getOrDefault (mParams, "LearningEAEnv.encoding", String(""))));
 		}
+		total += sizeof(PackedGenome) + ((plans[i]->packedSize ()+7) & ~7L);
+	}
+
+	char* p = (char*) writer.reserve (tag, total);
+	long long* count = (long long*) p;
+	p += sizeof(long long);
+	*count = 0;
+	for (int i=0; i<n; i++) {
+		PackedGenome* header = (PackedGenome*) p;
+		header->size    = plans[i]->packedSize ();
+		header->fitness = fitness? fitness[i] : 0.0;
+		p += sizeof(PackedGenome);
+		plans[i]->pack (p);
+		memset (p + header->size, 0, ((header->size+7) & ~7L) - header->size);
+		p += (header->size+7) & ~7L;
+		(*count)++;
 	}
+	delete [] plans;
+
+	return int (*count);
+}
+
+/*******************************************************************************
+ * The individuals are initialized with the random stream of their
+ * index, so restoring does not disturb the random sequence of the
+ * run.
+ ******************************************************************************/
+int LearningEAEnv::restoreGenomes (const Checkpoint& checkpoint, const char* tag,
+								   Individual** individuals, double* fitness, int max)
+{
+	long size;
+	const char* p = (const char*) checkpoint.section (tag, &size);
+	if (!p)
+		return 0;
+	const char* end = p + size;
+	ASSERTWITH (size >= long (sizeof(long long)), "Truncated genomes in checkpoint");
+	int count = int (*(const long long*) p);
+	p += sizeof(long long);
+
+	int restored = 0;
+	for (; restored<count && restored<max; restored++) {
+		const PackedGenome* header = (const PackedGenome*) p;
+		ASSERTWITH (end-p >= long (sizeof(PackedGenome)) && header->size >= 0
+					&& end-p-long (sizeof(PackedGenome)) >= ((header->size+7) & ~7L),
+					"Truncated genomes in checkpoint");
+		p += sizeof(PackedGenome);
+
+		RandomKey key;
+		key.seed       = mSeed;
+		key.generation = mGeneration;
+		key.individual = restored;
+		key.purpose    = RandomStream::INITIALIZATION;
+		RandomContext context (key);
+
+		Individual* ind = new Individual ();
+		addFeaturesTo (*ind);
+		ind->init ();
+		ANNEncoding* plan = dynamic_cast<ANNEncoding*> (const_cast<Genstruct*> (ind->getGene ("brainplan")));
+		ASSERT (plan);
+		plan->unpack (p, long (header->size));
+		plan->execute (GeneticMsg ("brainplan", *ind));
+
+		individuals[restored] = ind;
+		if (fitness)
+			fitness[restored] = header->fitness;
+		p += (header->size+7) & ~7L;
+	}
+
+	return restored;
 }
 
 /*******************************************************************************
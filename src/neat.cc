@@ -23,116 +23,141 @@
  ***************************************************************************/
 
 #include <magic/mclass.h>
+#include <inanna/annetwork.h>
+#include <nhp/individual.h>
 #include <annalee/neat.h>
+#include <annalee/neatnetwork.h>
+#include <annalee/randomstream.h>
 
-impl_inner_dynamic (NEATEncoding, NodeGene, {Gentainer});
-impl_inner_dynamic (NEATEncoding, ConnectionGene, {Gentainer});
 impl_dynamic (NEATEncoding, {ANNEncoding});
 
 //////////////////////////////////////////////////////////////////////////////
-//              |   |          |        ----                                //
-//              |\  |          |  ___  |      ___    _    ___               //
-//              | \ |  __   ---| /   ) | --- /   ) |/ \  /   )              //
-//              |  \| /  \ (   | |---  |   \ |---  |   | |---               //
-//              |   | \__/  ---|  \__  |___/  \__  |   |  \__               //
+//                                                                          //
+//         ___                                  o                           //
+//          |   _     _                ___  |            _                  //
+//          |  |/ \  |/ \   __  |   |  ___| -+- |   __  |/ \   ___          //
+//          |  |   | |   | /  \  \ /  (   | |   |  /  \ |   | (             //
+//         _|_ |   | |   | \__/   V    \__|  \  |  \__/ |   |  ---)         //
+//                                                                          //
 //////////////////////////////////////////////////////////////////////////////
 
-NEATEncoding::NodeGene::NodeGene (const GeneticID& name)
-		: Gentainer (name)
+NEATInnovations::NEATInnovations ()
+		: mNextInnovation (0),
+		  mNextNode (0)
 {
+	mConnections.mpSlots = NULL;
+	mConnections.mCapacity = 0;
+	mSplits.mpSlots = NULL;
+	mSplits.mCapacity = 0;
+	grow (mConnections);
+	grow (mSplits);
+	pthread_mutex_init (&mMutex, NULL);
 }
 
-NEATEncoding::NodeGene::NodeGene (const NodeGene& orig)
-		: Gentainer (orig)
+NEATInnovations::~NEATInnovations ()
 {
+	delete [] mConnections.mpSlots;
+	delete [] mSplits.mpSlots;
+	pthread_mutex_destroy (&mMutex);
 }
 
-void NEATEncoding::NodeGene::init ()
+int NEATInnovations::connection (int source, int target)
 {
-	Gentainer::init ();
+	pthread_mutex_lock (&mMutex);
+	int result = lookup (mConnections, source, target, mNextInnovation);
+	pthread_mutex_unlock (&mMutex);
+	return result;
 }
 
-/** Add genes needed by a NEAT node.
- *
- * A basic NEAT node does not contain any genes.
- */
-void NEATEncoding::NodeGene::addPrivateGenes (
-	Gentainer& g,
-	const StringMap& params)
+int NEATInnovations::splitNode (int source, int target)
 {
+	pthread_mutex_lock (&mMutex);
+	int result = lookup (mSplits, source, target, mNextNode);
+	pthread_mutex_unlock (&mMutex);
+	return result;
 }
 
-/////////////////////////////////////////////////////////////////////////////////
-//  ___                                   o             ----                   //
-// /   \        _     _    ___   ___   |           _   |      ___    _    ___  //
-// |      __  |/ \  |/ \  /   ) |   \ -+- |  __  |/ \  | --- /   ) |/ \  /   ) //
-// |     /  \ |   | |   | |---  |      |  | /  \ |   | |   \ |---  |   | |---  //
-// \___/ \__/ |   | |   |  \__   \__/   \ | \__/ |   | |___/  \__  |   |  \__  //
-//                                                                             //
-/////////////////////////////////////////////////////////////////////////////////
+void NEATInnovations::reserve (int innovations, int nodes)
+{
+	pthread_mutex_lock (&mMutex);
+	if (mNextInnovation < innovations)
+		mNextInnovation = innovations;
+	if (mNextNode < nodes)
+		mNextNode = nodes;
+	pthread_mutex_unlock (&mMutex);
+}
 
-/*******************************************************************************
- * Create a connection gene.
- *
- * A basic NEAT connection specifies two nodes: the source and the
- * target node. These can be changed during the lifetime of a
- * connection.
- *
- * A special feature of connections in NEAT is the "innovation
- * number", which allows finding corresponding genes during
- * crossover. The innovation number is enumerated globally in
- * NEATEncoding and assigned to connections on creation.
- *
- * Stanley & Miikkulainen 2002, p. 107.
- */ 
-NEATEncoding::ConnectionGene::ConnectionGene (
-	const GeneticID& name,       //< Name of the gene.
-	int              innovation, //< Innovation number.
-	int              source,     //< Source node.
-	int              target)     //< Target node
-		: Gentainer (name),
-		  mInnovation (innovation),
-		  mSource (source),
-		  mTarget (target)
+void NEATInnovations::newGeneration ()
 {
+	pthread_mutex_lock (&mMutex);
+	clear (mConnections);
+	clear (mSplits);
+	pthread_mutex_unlock (&mMutex);
 }
 
-NEATEncoding::ConnectionGene::ConnectionGene (const ConnectionGene& orig)
-		: Gentainer (orig),
-		  mInnovation (orig.mInnovation),
-		  mSource (orig.mSource),
-		  mTarget (orig.mTarget)
+/*******************************************************************************
+ * Finds the value for the given node pair, or inserts a new value
+ * taken from the counter if the pair is not in the table.
+ *
+ * Must be called with the mutex locked.
+ ******************************************************************************/
+int NEATInnovations::lookup (Table& table, int source, int target, int& counter)
 {
+	long long key = (((long long) source) << 32) | (unsigned int) target;
+
+	// Fibonacci hashing of the key to the table size
+	unsigned long long h = ((unsigned long long) key) * 0x9E3779B97F4A7C15ULL;
+	int mask = table.mCapacity-1;
+	for (int i = int (h >> 40) & mask; ; i = (i+1) & mask) {
+		Slot& slot = table.mpSlots[i];
+		if (slot.key == key)
+			return slot.value;
+		if (slot.key == -1) {
+			slot.key   = key;
+			slot.value = counter++;
+			table.mUsed++;
+
+			// Keep the load factor below 1/2
+			int value = slot.value;
+			if (table.mUsed*2 > table.mCapacity)
+				grow (table);
+			return value;
+		}
+	}
 }
 
-/** Implementation for @ref Genstruct. */
-void NEATEncoding::ConnectionGene::init ()
+void NEATInnovations::clear (Table& table)
 {
-	Gentainer::init ();
+	for (int i=0; i<table.mCapacity; i++)
+		table.mpSlots[i].key = -1;
+	table.mUsed = 0;
 }
 
 /*******************************************************************************
- * Add genes needed by a NEAT connection.
- *
- * A connection has an evolvable weight and an enabled
- * bit that says whether or not the gene is expressed.
- *
- * Stanley & Miikkulainen 2002, p. 107.
- */
-void NEATEncoding::ConnectionGene::addPrivateGenes (
-	Gentainer& g,
-	const StringMap& params)
+ * Doubles the capacity of a table and rehashes its contents.
+ ******************************************************************************/
+void NEATInnovations::grow (Table& table)
 {
-	Gentainer::addPrivateGenes(g, params);
+	Slot* oldSlots = table.mpSlots;
+	int oldCapacity = table.mCapacity;
 
-	// The expression gene - is the connection enabled?
-	add (new BinaryGene ("E"));
+	table.mCapacity = (oldCapacity>0)? oldCapacity*2 : 1024;
+	table.mpSlots = new Slot [table.mCapacity];
+	clear (table);
 
-	// Weight
-	add (new FloatGene ("W", -1.0, +1.0));
+	int mask = table.mCapacity-1;
+	for (int j=0; j<oldCapacity; j++)
+		if (oldSlots[j].key != -1) {
+			unsigned long long h = ((unsigned long long) oldSlots[j].key) * 0x9E3779B97F4A7C15ULL;
+			int i = int (h >> 40) & mask;
+			while (table.mpSlots[i].key != -1)
+				i = (i+1) & mask;
+			table.mpSlots[i] = oldSlots[j];
+			table.mUsed++;
+		}
+	delete [] oldSlots;
 }
 
-
 //////////////////////////////////////////////////////////////////////////////
 //    |   | -----   _   ----- -----                      | o                //
 //    |\  | |      / \    |   |       _    ___           |     _            //
@@ -142,13 +167,38 @@ void NEATEncoding::ConnectionGene::addPrivateGenes (
 //                                                                  __/     //
 //////////////////////////////////////////////////////////////////////////////
 
+NEATInnovations NEATEncoding::smInnovations;
+
 /*******************************************************************************
  * Constructor.
+ *
+ * @param params["NEATEncoding.addConnRate"] Probability of the
+ * add-connection mutation per genome. [Default=0.05]
+ *
+ * @param params["NEATEncoding.addNodeRate"] Probability of the
+ * add-node mutation per genome. [Default=0.03]
+ *
+ * @param params["NEATEncoding.weightVariance"] Variance of the
+ * Gaussian weight perturbation. [Default=0.1]
+ *
+ * @param params["NEATEncoding.toggleRate"] Probability of flipping
+ * the enabled bit of a connection. [Default=0.01]
+ *
+ * @param params["NEATEncoding.recurrent"] Whether recurrent
+ * connections may evolve. [Default=0]
+ *
+ * @param params["NEATEncoding.relaxation"] Number of relaxation
+ * steps of the compiled recurrent phenotype. [Default=5]
  ******************************************************************************/
 NEATEncoding::NEATEncoding (const GeneticID& name, const StringMap& params)
-		: ANNEncoding (name, params),
-		  mInnovationCounter(0)
+		: ANNEncoding (name, params)
 {
+	mAddConnRate    = getOrDefault (params, "NEATEncoding.addConnRate", String(0.05)).toDouble ();
+	mAddNodeRate    = getOrDefault (params, "NEATEncoding.addNodeRate", String(0.03)).toDouble ();
+	mWeightVariance = getOrDefault (params, "NEATEncoding.weightVariance", String(0.1)).toDouble ();
+	mToggleRate     = getOrDefault (params, "NEATEncoding.toggleRate", String(0.01)).toDouble ();
+	mRecurrent      = getOrDefault (params, "NEATEncoding.recurrent", String(0)).toInt ();
+	mRelaxation     = getOrDefault (params, "NEATEncoding.relaxation", String(5)).toInt ();
 }
 
 /*******************************************************************************
@@ -156,7 +206,13 @@ NEATEncoding::NEATEncoding (const GeneticID& name, const StringMap& params)
  ******************************************************************************/
 NEATEncoding::NEATEncoding (const NEATEncoding& other)
 		: ANNEncoding (other),
-		  mInnovationCounter(0)
+		  mGenome (other.mGenome),
+		  mAddConnRate (other.mAddConnRate),
+		  mAddNodeRate (other.mAddNodeRate),
+		  mWeightVariance (other.mWeightVariance),
+		  mToggleRate (other.mToggleRate),
+		  mRecurrent (other.mRecurrent),
+		  mRelaxation (other.mRelaxation)
 {
 }
 	
@@ -171,17 +227,28 @@ Genstruct* NEATEncoding::replicate () const
 /*******************************************************************************
  *
  ******************************************************************************/
-void NEATEncoding::copy (const Genstruct& other)
+void NEATEncoding::copy (const Genstruct& o)
 {
-	ANNEncoding::copy (other);
+	ANNEncoding::copy (o);
+	const NEATEncoding& other = static_cast<const NEATEncoding&>(o);
+	mGenome         = other.mGenome;
+	mAddConnRate    = other.mAddConnRate;
+	mAddNodeRate    = other.mAddNodeRate;
+	mWeightVariance = other.mWeightVariance;
+	mToggleRate     = other.mToggleRate;
+	mRecurrent      = other.mRecurrent;
+	mRelaxation     = other.mRelaxation;
 }
 
 /*******************************************************************************
  * Creates the NEAT genome.
  *
  * The genome consists of two lists: node list and connection list.
- * The node list will include all input and output nodes. The params
- * argument must include the following parameters:
+ * The input and output nodes are implicit, and every input is
+ * initially connected to every output, as in the minimal starting
+ * topology of Stanley & Miikkulainen (2002, p. 109). The following
+ * parameters override the number of inputs and outputs given by the
+ * environment:
  *
  * NEATEncoding.inputs   - Number of input units
  * NEATEncoding.outputs  - Number of output units
@@ -190,54 +257,282 @@ void NEATEncoding::addPrivateGenes (Gentainer& g, const StringMap& params)
 {
 	Gentainer::addPrivateGenes (g, params);
 
-	mInputs  = params["NEATEncoding.inputs"].toInt();
-	mOutputs = params["NEATEncoding.outputs"].toInt();
-	
-	// Add input nodes
-	for (int i=0; i<mInputs; i++, mInnovationCounter++) {
-		NodeGene* gene = new NodeGene (strformat ("U%d", mInnovationCounter));
-		gene->hide();
-		add (gene);
-	}
-	
-	// Add output nodes
-	for (int i=0; i<mOutputs; i++, mInnovationCounter++) {
-		NodeGene* gene = new NodeGene (strformat ("U%d", mInnovationCounter));
-		gene->hide();
-		add (gene);
-	}
+	mInputs  = getOrDefault (params, "NEATEncoding.inputs", String(mInputs)).toInt();
+	mOutputs = getOrDefault (params, "NEATEncoding.outputs", String(mOutputs)).toInt();
+
+	// The input and output nodes have fixed identifiers in all genomes
+	smInnovations.reserve (0, mInputs+mOutputs);
+
+	// Connect all inputs to all outputs
+	mGenome.clear ();
+	for (int i=0; i<mInputs; i++)
+		for (int j=mInputs; j<mInputs+mOutputs; j++)
+			mGenome.add (smInnovations.connection (i, j), i, j, 0.0);
 }
 
 /*******************************************************************************
  * Implementation for Genstruct.
+ *
+ * Each weight is perturbed with the probability given by the mutation
+ * rate, and the connections are toggled on and off with the toggle
+ * rate. The genome may also grow with the add-connection and
+ * add-node mutations (Stanley & Miikkulainen 2002, p. 107).
  ******************************************************************************/
 bool NEATEncoding::pointMutate (const MutationRate& r)
 {
-	// Normal point mutations
+	bool mutated = Gentainer::pointMutate (r);
 
-	// Add connection mutation
+	// Normal point mutations, each weight with the mutation rate
+	const double rate = r.getvalue ();
+	for (int i=0; i<mGenome.size(); i++) {
+		if (streamFrnd() < rate) {
+			mGenome.setWeight (i, mGenome.weight (i) + streamGaussrnd (mWeightVariance));
+			mutated = true;
+		}
+		if (streamFrnd() < mToggleRate) {
+			mGenome.enable (i, !mGenome.enabled (i));
+			mutated = true;
+		}
+	}
 
-	// Find two previously unconnected nodes.
+	// Add connection mutation
+	if (streamFrnd() < mAddConnRate && addConnection ())
+		mutated = true;
 
 	// Add node mutation
+	if (streamFrnd() < mAddNodeRate && addNode ())
+		mutated = true;
 
-	// Find a random connection to replace with a node and two connections
+	return mutated;
+}
+
+/*******************************************************************************
+ * Add-connection mutation.
+ *
+ * Connects two previously unconnected nodes with a new connection
+ * gene. Unless recurrent connections are enabled, connections that
+ * would create a cycle are not added, as the phenotype is then a
+ * feed-forward network.
+ *
+ * @return True if a connection was added.
+ ******************************************************************************/
+bool NEATEncoding::addConnection ()
+{
+	int fixed = mInputs+mOutputs;
+	int nodes = fixed + mGenome.nodes();
+
+	// Find two previously unconnected nodes. A few tries should be
+	// enough for all but almost fully connected genomes.
+	for (int tries=0; tries<20; tries++) {
+		int s = streamRnd (nodes);
+		int t = streamRnd (nodes);
+		int source = (s < fixed)? s : mGenome.node (s-fixed);
+		int target = (t < fixed)? t : mGenome.node (t-fixed);
+
+		// Inputs can't be targets and, in feed-forward networks,
+		// outputs can't be sources
+		if (target < mInputs || mGenome.contains (source, target))
+			continue;
+		if (!mRecurrent && ((source >= mInputs && source < fixed)
+							|| source == target || reachable (target, source)))
+			continue;
 
+		mGenome.add (smInnovations.connection (source, target), source, target,
+					 2*streamFrnd()-1);
+		return true;
+	}
 	return false;
 }
 
 /*******************************************************************************
+ * Add-node mutation.
+ *
+ * Splits a random enabled connection A->B with a new node C. The old
+ * connection is disabled and replaced with connections A->C, which
+ * gets weight 1, and C->B, which inherits the old weight.
  *
+ * @return True if a node was added.
+ ******************************************************************************/
+bool NEATEncoding::addNode ()
+{
+	// Count the enabled connections
+	int enabled = 0;
+	for (int i=0; i<mGenome.size(); i++)
+		if (mGenome.enabled (i))
+			enabled++;
+	if (enabled == 0)
+		return false;
+
+	// Find a random connection to replace with a node and two connections
+	int split = -1;
+	for (int i=0, k=streamRnd (enabled); i<mGenome.size() && split==-1; i++)
+		if (mGenome.enabled (i) && k-- == 0)
+			split = i;
+	ASSERT (split != -1);
+
+	int source = mGenome.source (split);
+	int target = mGenome.target (split);
+	double weight = mGenome.weight (split);
+
+	// The same split during this generation gives the same node
+	int node = smInnovations.splitNode (source, target);
+	if (mGenome.hasNode (node))
+		return false; // Already split once in this genome
+
+	mGenome.enable (split, false);
+	mGenome.addNode (node);
+	mGenome.add (smInnovations.connection (source, node), source, node, 1.0);
+	mGenome.add (smInnovations.connection (node, target), node, target, weight);
+	return true;
+}
+
+/*******************************************************************************
+ * Checks if the node "to" can be reached from the node "from" along
+ * the connections of the genome.
+ ******************************************************************************/
+bool NEATEncoding::reachable (int from, int to) const
+{
+	if (from == to)
+		return true;
+
+	// Only hidden nodes can be on a path between two other nodes, so
+	// the visited set is indexed by the hidden node index
+	int hiddens = mGenome.nodes();
+	bool* visited = new bool [hiddens+1];
+	int* stack = new int [hiddens+2];
+	for (int h=0; h<hiddens; h++)
+		visited[h] = false;
+
+	int top = 0;
+	stack[top++] = from;
+	bool found = false;
+	while (top > 0 && !found) {
+		int node = stack[--top];
+		for (int i=0; i<mGenome.size() && !found; i++) {
+			if (mGenome.source (i) != node)
+				continue;
+			int next = mGenome.target (i);
+			if (next == to)
+				found = true;
+			else {
+				int h = mGenome.findNode (next);
+				if (h != -1 && !visited[h]) {
+					visited[h] = true;
+					stack[top++] = next;
+				}
+			}
+		}
+	}
+
+	delete [] visited;
+	delete [] stack;
+	return found;
+}
+
+/*******************************************************************************
+ * Makes this genome an offspring of two NEAT parents.
+ ******************************************************************************/
+void NEATEncoding::crossover (const NEATEncoding& fitter, const NEATEncoding& other)
+{
+	mGenome.crossover (fitter.mGenome, other.mGenome);
+}
+
+/*******************************************************************************
+ * Initializes the connection weights and enables all the connections
+ * of the initial topology.
  ******************************************************************************/
 void NEATEncoding::init ()
 {
+	Gentainer::init ();
+
+	for (int i=0; i<mGenome.size(); i++) {
+		mGenome.setWeight (i, 2*streamFrnd()-1);
+		mGenome.enable (i, true);
+	}
 }
 
 /*******************************************************************************
+ * Builds the phenotype network from the genome.
  *
+ * The hidden nodes are placed in the network in topological order,
+ * so that all the connections are forward connections. Disabled
+ * connections are not expressed. The connection weights are set to
+ * the evolved values.
+ *
+ * If recurrent connections are enabled, the genome is also compiled
+ * to a @ref NEATNetwork, which is placed in the host as "neatbrain".
+ * The recurrent connections are left out of the feed-forward
+ * "brainplan".
  ******************************************************************************/
 bool NEATEncoding::execute (const GeneticMsg& msg) const
 {
-	return false;
+	// Take pictures only if this is a picture-taking recreation
+	bool takePics = dynamic_cast<const TakeBrainPicsMsg*>(&msg) != NULL;
+
+	int hiddens = mGenome.nodes();
+
+	// Hidden index -> unit index
+	int* order = new int [hiddens+1];
+	bool acyclic = NEATNetwork::activationOrder (mGenome, mInputs, order);
+	ASSERTWITH (acyclic || mRecurrent, "Cycle in a feed-forward NEAT genome");
+
+	ANNetwork* net = new ANNetwork (format ("%d-%d-%d", mInputs, hiddens, mOutputs));
+
+	// Connect the enabled connections with their evolved weights
+	String desc;
+	for (int i=0; i<mGenome.size(); i++) {
+		if (takePics)
+			desc += format ("%d: %d -> %d, w=%+f%s\n", mGenome.innovation (i),
+							mGenome.source (i), mGenome.target (i), mGenome.weight (i),
+							mGenome.enabled (i)? "" : " (disabled)");
+		if (!mGenome.enabled (i))
+			continue;
+
+		// Map node identifiers to unit indices: inputs, hiddens, outputs
+		int source = NEATNetwork::unitIndex (mGenome, mInputs, mOutputs, order,
+											 mGenome.source (i));
+		int target = NEATNetwork::unitIndex (mGenome, mInputs, mOutputs, order,
+											 mGenome.target (i));
+		if (source >= target)
+			continue; // Recurrent connection
+
+		net->connect (source, target);
+		Neuron& neuron = (*net)[target];
+		neuron.incoming (neuron.incomings()-1).setWeight (mGenome.weight (i));
+	}
+	delete [] order;
+
+	// Take some nice photos
+	if (takePics)
+		msg.mrHost.set ("brainpic1", new String (net->drawEPS()));
+	net->cleanup (true, mPrunePassthroughs);
+	if (takePics) {
+		msg.mrHost.set ("brainpic2", new String (net->drawEPS()));
+		net->drawFeedForward();
+		msg.mrHost.set ("brainpic3", new String (net->drawEPS()));
+		msg.mrHost.set ("braindesc1", new String (desc));
+		delete net; // The net was created only for taking babypics
+	} else {
+		// Place the brain description into host
+		msg.mrHost.set ("brainplan", net);
+		if (mRecurrent)
+			msg.mrHost.set ("neatbrain",
+							new NEATNetwork (mGenome, mInputs, mOutputs, mRelaxation));
+	}
+
+	return true;
 }
 
+/*******************************************************************************
+ * Implementation for @ref Object.
+ ******************************************************************************/
+void NEATEncoding::check () const
+{
+	ANNEncoding::check ();
+	mGenome.check ();
+	ASSERT (mAddConnRate>=0 && mAddConnRate<=1);
+	ASSERT (mAddNodeRate>=0 && mAddNodeRate<=1);
+	ASSERT (mToggleRate>=0 && mToggleRate<=1);
+	ASSERT (mWeightVariance>=0);
+	ASSERT (mRelaxation>0);
+}
@@ -0,0 +1,375 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include <nhp/genetics.h>
+#include "annalee/neatgenome.h"
+#include "annalee/randomstream.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//     |   | -----   _   -----     ___                                      //
+//     |\  | |      / \    |      /   \  ___   _                  ___       //
+//     | \ | |---  /   \   |      | __  /   ) |/ \   __  |/\/\   /   )      //
+//     |  \| |     |---|   |      |   | |---  |   | /  \ |  |  | |---       //
+//     |   | |____ |   |   |      \___/  \__  |   | \__/ |  |  |  \__       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+NEATGenome::NEATGenome ()
+		: mSize (0), mCapacity (0),
+		  mpInnovation (NULL), mpSource (NULL), mpTarget (NULL),
+		  mpWeight (NULL), mpEnabled (NULL),
+		  mNodes (0), mNodeCapacity (0), mpNodes (NULL)
+{
+}
+
+NEATGenome::NEATGenome (const NEATGenome& other)
+		: mSize (0), mCapacity (0),
+		  mpInnovation (NULL), mpSource (NULL), mpTarget (NULL),
+		  mpWeight (NULL), mpEnabled (NULL),
+		  mNodes (0), mNodeCapacity (0), mpNodes (NULL)
+{
+	*this = other;
+}
+
+NEATGenome::~NEATGenome ()
+{
+	delete [] mpInnovation;
+	delete [] mpSource;
+	delete [] mpTarget;
+	delete [] mpWeight;
+	delete [] mpEnabled;
+	delete [] mpNodes;
+}
+
+NEATGenome& NEATGenome::operator= (const NEATGenome& other)
+{
+	if (&other == this)
+		return *this;
+
+	reserve (other.mSize);
+	mSize = other.mSize;
+	memcpy (mpInnovation, other.mpInnovation, mSize*sizeof(int));
+	memcpy (mpSource, other.mpSource, mSize*sizeof(int));
+	memcpy (mpTarget, other.mpTarget, mSize*sizeof(int));
+	memcpy (mpWeight, other.mpWeight, mSize*sizeof(double));
+	memcpy (mpEnabled, other.mpEnabled, mSize*sizeof(bool));
+
+	reserveNodes (other.mNodes);
+	mNodes = other.mNodes;
+	memcpy (mpNodes, other.mpNodes, mNodes*sizeof(int));
+	return *this;
+}
+
+/*******************************************************************************
+ * Grows the connection arrays to hold at least the given number of
+ * genes. The capacity is doubled so that appending is amortized O(1).
+ ******************************************************************************/
+void NEATGenome::reserve (int capacity)
+{
+	if (capacity <= mCapacity)
+		return;
+	if (capacity < mCapacity*2)
+		capacity = mCapacity*2;
+	if (capacity < 16)
+		capacity = 16;
+
+	int*    innovation = new int [capacity];
+	int*    source     = new int [capacity];
+	int*    target     = new int [capacity];
+	double* weight     = new double [capacity];
+	bool*   enabled    = new bool [capacity];
+	if (mSize > 0) {
+		memcpy (innovation, mpInnovation, mSize*sizeof(int));
+		memcpy (source, mpSource, mSize*sizeof(int));
+		memcpy (target, mpTarget, mSize*sizeof(int));
+		memcpy (weight, mpWeight, mSize*sizeof(double));
+		memcpy (enabled, mpEnabled, mSize*sizeof(bool));
+	}
+	delete [] mpInnovation;
+	delete [] mpSource;
+	delete [] mpTarget;
+	delete [] mpWeight;
+	delete [] mpEnabled;
+	mpInnovation = innovation;
+	mpSource     = source;
+	mpTarget     = target;
+	mpWeight     = weight;
+	mpEnabled    = enabled;
+	mCapacity    = capacity;
+}
+
+void NEATGenome::reserveNodes (int capacity)
+{
+	if (capacity <= mNodeCapacity)
+		return;
+	if (capacity < mNodeCapacity*2)
+		capacity = mNodeCapacity*2;
+	if (capacity < 16)
+		capacity = 16;
+
+	int* nodes = new int [capacity];
+	if (mNodes > 0)
+		memcpy (nodes, mpNodes, mNodes*sizeof(int));
+	delete [] mpNodes;
+	mpNodes = nodes;
+	mNodeCapacity = capacity;
+}
+
+int NEATGenome::add (int innovation, int source, int target, double weight, bool enabled)
+{
+	reserve (mSize+1);
+
+	// Find the place of the gene; usually it is the last one
+	int pos = mSize;
+	while (pos > 0 && mpInnovation[pos-1] > innovation)
+		pos--;
+	ASSERTWITH (pos == 0 || mpInnovation[pos-1] != innovation,
+				"Duplicate innovation number in a NEAT genome");
+
+	int tail = mSize-pos;
+	if (tail > 0) {
+		memmove (mpInnovation+pos+1, mpInnovation+pos, tail*sizeof(int));
+		memmove (mpSource+pos+1, mpSource+pos, tail*sizeof(int));
+		memmove (mpTarget+pos+1, mpTarget+pos, tail*sizeof(int));
+		memmove (mpWeight+pos+1, mpWeight+pos, tail*sizeof(double));
+		memmove (mpEnabled+pos+1, mpEnabled+pos, tail*sizeof(bool));
+	}
+	mpInnovation[pos] = innovation;
+	mpSource[pos]     = source;
+	mpTarget[pos]     = target;
+	mpWeight[pos]     = weight;
+	mpEnabled[pos]    = enabled;
+	mSize++;
+	return pos;
+}
+
+int NEATGenome::find (int innovation) const
+{
+	int lo = 0, hi = mSize-1;
+	while (lo <= hi) {
+		int mid = (lo+hi)/2;
+		if (mpInnovation[mid] < innovation)
+			lo = mid+1;
+		else if (mpInnovation[mid] > innovation)
+			hi = mid-1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+bool NEATGenome::contains (int source, int target) const
+{
+	for (int i=0; i<mSize; i++)
+		if (mpSource[i] == source && mpTarget[i] == target)
+			return true;
+	return false;
+}
+
+void NEATGenome::clear ()
+{
+	mSize = 0;
+	mNodes = 0;
+}
+
+void NEATGenome::addNode (int id)
+{
+	reserveNodes (mNodes+1);
+
+	int pos = mNodes;
+	while (pos > 0 && mpNodes[pos-1] > id)
+		pos--;
+	if (pos < mNodes)
+		memmove (mpNodes+pos+1, mpNodes+pos, (mNodes-pos)*sizeof(int));
+	mpNodes[pos] = id;
+	mNodes++;
+}
+
+int NEATGenome::findNode (int id) const
+{
+	int lo = 0, hi = mNodes-1;
+	while (lo <= hi) {
+		int mid = (lo+hi)/2;
+		if (mpNodes[mid] < id)
+			lo = mid+1;
+		else if (mpNodes[mid] > id)
+			hi = mid-1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+void NEATGenome::crossover (const NEATGenome& fitter, const NEATGenome& other)
+{
+	ASSERT (&fitter != this && &other != this);
+
+	clear ();
+	reserve (fitter.mSize);
+
+	// Merge the genes along the innovation numbers
+	int i=0, j=0;
+	while (i < fitter.mSize) {
+		if (j < other.mSize && other.mpInnovation[j] < fitter.mpInnovation[i]) {
+			j++; // Disjoint gene of the less fit parent
+			continue;
+		}
+
+		int pos = mSize++;
+		mpInnovation[pos] = fitter.mpInnovation[i];
+		mpSource[pos]     = fitter.mpSource[i];
+		mpTarget[pos]     = fitter.mpTarget[i];
+
+		if (j < other.mSize && other.mpInnovation[j] == fitter.mpInnovation[i]) {
+			// Matching gene, inherited randomly
+			const NEATGenome& parent = (streamFrnd() < 0.5)? fitter : other;
+			int k = (&parent == &fitter)? i : j;
+			mpWeight[pos]  = parent.mpWeight[k];
+			mpEnabled[pos] = (fitter.mpEnabled[i] && other.mpEnabled[j])
+				|| streamFrnd() >= 0.75;
+			j++;
+		} else {
+			// Disjoint or excess gene of the fitter parent
+			mpWeight[pos]  = fitter.mpWeight[i];
+			mpEnabled[pos] = fitter.mpEnabled[i];
+		}
+		i++;
+	}
+
+	// The offspring has the nodes of the fitter parent
+	reserveNodes (fitter.mNodes);
+	mNodes = fitter.mNodes;
+	memcpy (mpNodes, fitter.mpNodes, mNodes*sizeof(int));
+}
+
+double NEATGenome::distance (const NEATGenome& other, double c1, double c2, double c3) const
+{
+	return distance (mpInnovation, mpWeight, mSize,
+					 other.mpInnovation, other.mpWeight, other.mSize, c1, c2, c3);
+}
+
+double NEATGenome::distance (const int* innovA, const double* weightA, int sizeA,
+							 const int* innovB, const double* weightB, int sizeB,
+							 double c1, double c2, double c3)
+{
+	int matching = 0, disjoint = 0, excess = 0;
+	double weightDiff = 0.0;
+
+	int i=0, j=0;
+	while (i < sizeA && j < sizeB) {
+		if (innovA[i] == innovB[j]) {
+			matching++;
+			weightDiff += fabs (weightA[i] - weightB[j]);
+			i++;
+			j++;
+		} else if (innovA[i] < innovB[j]) {
+			disjoint++;
+			i++;
+		} else {
+			disjoint++;
+			j++;
+		}
+	}
+	excess = (sizeA-i) + (sizeB-j);
+
+	// Small genomes are not normalized by their size
+	int n = (sizeA > sizeB)? sizeA : sizeB;
+	if (n < 20)
+		n = 1;
+
+	return c1*excess/n + c2*disjoint/n + ((matching>0)? c3*weightDiff/matching : 0.0);
+}
+
+/*******************************************************************************
+ * The packed genome consists of the gene and node counts, followed by
+ * the weights and the integer arrays, and the enabled bits as bytes.
+ ******************************************************************************/
+long NEATGenome::packedSize () const
+{
+	return 2*sizeof(int) + mSize*(sizeof(double) + 3*sizeof(int) + 1) + mNodes*sizeof(int);
+}
+
+void NEATGenome::pack (void* buffer) const
+{
+	int* counts = (int*) buffer;
+	counts[0] = mSize;
+	counts[1] = mNodes;
+	char* p = (char*) (counts+2);
+	memcpy (p, mpWeight, mSize*sizeof(double));		p += mSize*sizeof(double);
+	memcpy (p, mpInnovation, mSize*sizeof(int));	p += mSize*sizeof(int);
+	memcpy (p, mpSource, mSize*sizeof(int));		p += mSize*sizeof(int);
+	memcpy (p, mpTarget, mSize*sizeof(int));		p += mSize*sizeof(int);
+	memcpy (p, mpNodes, mNodes*sizeof(int));		p += mNodes*sizeof(int);
+	for (int i=0; i<mSize; i++)
+		p[i] = mpEnabled[i];
+}
+
+void NEATGenome::unpack (const void* buffer, long size)
+{
+	const int* counts = (const int*) buffer;
+	ASSERTWITH (size >= long (2*sizeof(int)), "Truncated NEAT genome");
+	int genes = counts[0], nodes = counts[1];
+	ASSERTWITH (genes >= 0 && nodes >= 0 &&
+				size == 2*long (sizeof(int)) + genes*long (sizeof(double) + 3*sizeof(int) + 1)
+				+ nodes*long (sizeof(int)), "Truncated NEAT genome");
+
+	clear ();
+	reserve (genes);
+	reserveNodes (nodes);
+	mSize  = genes;
+	mNodes = nodes;
+	const char* p = (const char*) (counts+2);
+	memcpy (mpWeight, p, mSize*sizeof(double));		p += mSize*sizeof(double);
+	memcpy (mpInnovation, p, mSize*sizeof(int));	p += mSize*sizeof(int);
+	memcpy (mpSource, p, mSize*sizeof(int));		p += mSize*sizeof(int);
+	memcpy (mpTarget, p, mSize*sizeof(int));		p += mSize*sizeof(int);
+	memcpy (mpNodes, p, mNodes*sizeof(int));		p += mNodes*sizeof(int);
+	for (int i=0; i<mSize; i++)
+		mpEnabled[i] = p[i];
+
+	// Crossover and distance merge the genes by innovation, so a
+	// corrupt genome must not get through
+	bool sorted = true;
+	for (int i=1; sorted && i<mSize; i++)
+		sorted = mpInnovation[i-1] < mpInnovation[i];
+	for (int i=1; sorted && i<mNodes; i++)
+		sorted = mpNodes[i-1] < mpNodes[i];
+	if (!sorted) {
+		clear ();
+		throw generic_exception ("Unsorted or duplicate innovations in a NEAT genome");
+	}
+}
+
+void NEATGenome::check () const
+{
+	ASSERT (mSize>=0 && mSize<=mCapacity);
+	ASSERT (mNodes>=0 && mNodes<=mNodeCapacity);
+	for (int i=1; i<mSize; i++)
+		ASSERT (mpInnovation[i-1] < mpInnovation[i]);
+	for (int i=1; i<mNodes; i++)
+		ASSERT (mpNodes[i-1] < mpNodes[i]);
+}
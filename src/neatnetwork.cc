@@ -0,0 +1,343 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include <magic/mclass.h>
+#include <inanna/annetwork.h>
+#include <annalee/neatnetwork.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//       |   | -----   _   ----- |   |                            |         //
+//       |\  | |      / \    |   |\  |  ___  |                    |         //
+//       | \ | |---  /   \   |   | \ | /   ) -+- |     |  __  |/\ | /       //
+//       |  \| |     |---|   |   |  \| |---  |   |  |  | /  \ |   |<        //
+//       |   | |____ |   |   |   |   |  \__   \   \/ \/  \__/ |   | \       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+NEATNetwork::NEATNetwork (const NEATGenome& genome, int inputs, int outputs, int steps)
+		: mInputs (inputs),
+		  mOutputs (outputs),
+		  mSteps (steps)
+{
+	int hiddens = genome.nodes();
+	mUnits = inputs + hiddens + outputs;
+
+	int* order = new int [hiddens+1];
+	activationOrder (genome, inputs, order);
+
+	// Count the incoming connections of each unit
+	mpStart = new int [mUnits+1];
+	for (int u=0; u<=mUnits; u++)
+		mpStart[u] = 0;
+	for (int i=0; i<genome.size(); i++)
+		if (genome.enabled (i))
+			mpStart[unitIndex (genome, inputs, outputs, order, genome.target (i))+1]++;
+	for (int u=0; u<mUnits; u++)
+		mpStart[u+1] += mpStart[u];
+
+	// Place the connections in the rows of their target units
+	int conns = mpStart[mUnits];
+	mpSource = new int [conns+1];
+	mpWeight = new double [conns+1];
+	int* fill = new int [mUnits];
+	memcpy (fill, mpStart, mUnits*sizeof(int));
+	for (int i=0; i<genome.size(); i++) {
+		if (!genome.enabled (i))
+			continue;
+		int s = unitIndex (genome, inputs, outputs, order, genome.source (i));
+		int t = unitIndex (genome, inputs, outputs, order, genome.target (i));
+		int k = fill[t]++;
+		// Forward connections read the current state, recurrent ones the previous
+		mpSource[k] = (s < t)? mUnits+s : s;
+		mpWeight[k] = genome.weight (i);
+	}
+	delete [] fill;
+	delete [] order;
+
+	mpBuffer = new double [2*mUnits];
+	reset ();
+}
+
+NEATNetwork::NEATNetwork (int inputs, int hiddens, int outputs, int* start,
+						  int* source, double* weight, int steps)
+		: mInputs (inputs),
+		  mOutputs (outputs),
+		  mUnits (inputs+hiddens+outputs),
+		  mSteps (steps),
+		  mpStart (start),
+		  mpSource (source),
+		  mpWeight (weight)
+{
+	for (int t=0; t<mUnits; t++)
+		for (int k=mpStart[t]; k<mpStart[t+1]; k++)
+			if (mpSource[k] < t)
+				mpSource[k] += mUnits;
+
+	mpBuffer = new double [2*mUnits];
+	reset ();
+}
+
+NEATNetwork::~NEATNetwork ()
+{
+	delete [] mpStart;
+	delete [] mpSource;
+	delete [] mpWeight;
+	delete [] mpBuffer;
+}
+
+void NEATNetwork::reset ()
+{
+	for (int u=0; u<2*mUnits; u++)
+		mpBuffer[u] = 0.0;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+const double* NEATNetwork::activate (const double* input)
+{
+	return relax (input, mpBuffer);
+}
+
+/*******************************************************************************
+ * Relaxes the network for the configured number of steps in the
+ * given state buffer. The units are updated with the logistic
+ * function.
+ ******************************************************************************/
+const double* NEATNetwork::relax (const double* input, double* buffer) const
+{
+	double* current = buffer + mUnits;
+	memcpy (current, input, mInputs*sizeof(double));
+
+	for (int step=0; step<mSteps; step++) {
+		// The current state becomes the previous state
+		memcpy (buffer, current, mUnits*sizeof(double));
+
+		for (int u=mInputs; u<mUnits; u++) {
+			double sum = 0.0;
+			for (int k=mpStart[u]; k<mpStart[u+1]; k++)
+				sum += mpWeight[k] * buffer[mpSource[k]];
+			current[u] = 1.0/(1.0+exp(-sum));
+		}
+	}
+
+	return current + mUnits - mOutputs;
+}
+
+/*******************************************************************************
+ * Uses a private state buffer, so the state of the network is not
+ * changed.
+ ******************************************************************************/
+double NEATNetwork::test (const PatternSet& set, int* failures) const
+{
+	ASSERT (set.inputs == mInputs && set.outputs == mOutputs);
+
+	double* input = new double [mInputs+1];
+	double* buffer = new double [2*mUnits];
+	double sse = 0.0;
+	if (failures)
+		*failures = 0;
+	for (int p=0; p<set.patterns; p++) {
+		for (int i=0; i<mInputs; i++)
+			input[i] = set.input (p, i);
+		for (int u=0; u<2*mUnits; u++)
+			buffer[u] = 0.0;
+		const double* output = relax (input, buffer);
+		for (int o=0; o<mOutputs; o++) {
+			double err = output[o] - set.output (p, o);
+			sse += err*err;
+		}
+
+		if (failures) {
+			if (mOutputs == 1) {
+				if ((output[0] > 0.5) != (set.output (p, 0) > 0.5))
+					(*failures)++;
+			} else {
+				int predicted = 0, correct = 0;
+				for (int o=1; o<mOutputs; o++) {
+					if (output[o] > output[predicted])
+						predicted = o;
+					if (set.output (p, o) > set.output (p, correct))
+						correct = o;
+				}
+				if (predicted != correct)
+					(*failures)++;
+			}
+		}
+	}
+	delete [] input;
+	delete [] buffer;
+
+	return (set.patterns>0)? sse/(set.patterns*mOutputs) : 0.0;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int NEATNetwork::connect (ANNetwork& net, bool recurrent) const
+{
+	int made = 0;
+	for (int t=mInputs; t<mUnits; t++)
+		for (int k=mpStart[t]; k<mpStart[t+1]; k++) {
+			// The recurrent connections read the previous state
+			bool previous = mpSource[k] < mUnits;
+			if (previous && !recurrent)
+				continue;
+			net.connect (previous? mpSource[k] : mpSource[k]-mUnits, t);
+			Neuron& neuron = net[t];
+			neuron.incoming (neuron.incomings()-1).setWeight (mpWeight[k]);
+			made++;
+		}
+	return made;
+}
+
+/*******************************************************************************
+ * The recurrent connections are marked with an 'r'.
+ ******************************************************************************/
+String NEATNetwork::toString () const
+{
+	String result = format ("%d inputs, %d hiddens, %d outputs, %d steps\n",
+							mInputs, mUnits-mInputs-mOutputs, mOutputs, mSteps);
+	for (int t=mInputs; t<mUnits; t++)
+		for (int k=mpStart[t]; k<mpStart[t+1]; k++) {
+			bool previous = mpSource[k] < mUnits;
+			result += format ("%d -> %d%s, w=%+f\n", previous? mpSource[k] : mpSource[k]-mUnits,
+							  t, previous? " r" : "", mpWeight[k]);
+		}
+	return result;
+}
+
+/*******************************************************************************
+ * Sorts the hidden nodes topologically with Kahn's algorithm,
+ * breaking the cycles at the nodes with fewest pending sources.
+ ******************************************************************************/
+bool NEATNetwork::activationOrder (const NEATGenome& genome, int inputs, int* order)
+{
+	int hiddens = genome.nodes();
+	if (hiddens == 0)
+		return true;
+
+	// Hidden-to-hidden adjacency lists of the enabled connections,
+	// excluding self-connections
+	int* pending = new int [hiddens];
+	int* first = new int [hiddens+1];
+	for (int h=0; h<=hiddens; h++)
+		first[h] = 0;
+	for (int h=0; h<hiddens; h++)
+		pending[h] = 0;
+	int* sourceIndex = new int [genome.size()+1];
+	int* targetIndex = new int [genome.size()+1];
+	for (int i=0; i<genome.size(); i++) {
+		sourceIndex[i] = targetIndex[i] = -1;
+		if (!genome.enabled (i) || genome.source (i) == genome.target (i))
+			continue;
+		int s = genome.findNode (genome.source (i));
+		int t = genome.findNode (genome.target (i));
+		if (s != -1 && t != -1) {
+			sourceIndex[i] = s;
+			targetIndex[i] = t;
+			first[s+1]++;
+			pending[t]++;
+		}
+	}
+	for (int h=0; h<hiddens; h++)
+		first[h+1] += first[h];
+	int* next = new int [first[hiddens]+1];
+	int* fill = new int [hiddens+1];
+	memcpy (fill, first, hiddens*sizeof(int));
+	for (int i=0; i<genome.size(); i++)
+		if (sourceIndex[i] != -1)
+			next[fill[sourceIndex[i]]++] = targetIndex[i];
+	delete [] fill;
+	delete [] sourceIndex;
+	delete [] targetIndex;
+
+	bool* queued = new bool [hiddens];
+	int* queue = new int [hiddens];
+	int head = 0, tail = 0;
+	for (int h=0; h<hiddens; h++)
+		if ((queued[h] = (pending[h] == 0)))
+			queue[tail++] = h;
+
+	bool acyclic = true;
+	while (head < hiddens) {
+		if (head == tail) {
+			// Only cycles remain; place the node closest to being free
+			int best = -1;
+			for (int h=0; h<hiddens; h++)
+				if (!queued[h] && (best == -1 || pending[h] < pending[best]))
+					best = h;
+			queued[best] = true;
+			queue[tail++] = best;
+			acyclic = false;
+		}
+		int h = queue[head++];
+		order[h] = inputs + head-1;
+		for (int k=first[h]; k<first[h+1]; k++) {
+			int t = next[k];
+			if (--pending[t] == 0 && !queued[t]) {
+				queued[t] = true;
+				queue[tail++] = t;
+			}
+		}
+	}
+
+	delete [] pending;
+	delete [] first;
+	delete [] next;
+	delete [] queued;
+	delete [] queue;
+	return acyclic;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+int NEATNetwork::unitIndex (const NEATGenome& genome, int inputs, int outputs,
+							const int* order, int node)
+{
+	if (node < inputs)
+		return node;
+	if (node < inputs+outputs)
+		return node + genome.nodes();
+	int h = genome.findNode (node);
+	ASSERT (h != -1);
+	return order[h];
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+void NEATNetwork::check () const
+{
+	ASSERT (mInputs>0 && mOutputs>0 && mUnits>=mInputs+mOutputs);
+	ASSERT (mSteps>0);
+	for (int u=0; u<mUnits; u++)
+		ASSERT (mpStart[u] <= mpStart[u+1]);
+	for (int k=0; k<mpStart[mUnits]; k++)
+		ASSERT (mpSource[k]>=0 && mpSource[k]<2*mUnits);
+}
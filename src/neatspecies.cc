@@ -0,0 +1,247 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <nhp/genetics.h>
+#include <annalee/neatspecies.h>
+#include <annalee/randomstream.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//             ___                   o            o                         //
+//            (   \       ___            ___  |            _                //
+//             \__  |--  /   )  ___  |   ___| -+- |   __  |/ \              //
+//                ) |  ) |---  /     |  (   | |   |  /  \ |   |             //
+//            \___) |--   \__  \___  |   \__|  \  |  \__/ |   |             //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+NEATSpeciation::NEATSpeciation (const StringMap& params)
+		: mpReps (NULL), mSpecies (0), mCapacity (0)
+{
+	mThreshold = getOrDefault (params, "NEATSpeciation.threshold", String(3.0)).toDouble ();
+	mC1        = getOrDefault (params, "NEATSpeciation.c1", String(1.0)).toDouble ();
+	mC2        = getOrDefault (params, "NEATSpeciation.c2", String(1.0)).toDouble ();
+	mC3        = getOrDefault (params, "NEATSpeciation.c3", String(0.4)).toDouble ();
+	mThreads   = getOrDefault (params, "NEATSpeciation.threads", String(0)).toInt ();
+	if (mThreads <= 0)
+		mThreads = int (sysconf (_SC_NPROCESSORS_ONLN));
+	if (mThreads <= 0)
+		mThreads = 1;
+}
+
+NEATSpeciation::~NEATSpeciation ()
+{
+	for (int s=0; s<mCapacity; s++) {
+		delete [] mpReps[s].innovations;
+		delete [] mpReps[s].weights;
+	}
+	delete [] mpReps;
+}
+
+/*******************************************************************************
+ * Speciates a population.
+ *
+ * First all the genomes are compared against the representatives of
+ * the previous generation in parallel. The genomes that do not fit in
+ * any old species are then compared serially against the new species
+ * created during this round. Finally the empty species are dropped
+ * and a random member of each species is cached as its new
+ * representative, drawn from the random stream of the caller.
+ ******************************************************************************/
+void NEATSpeciation::speciate (const NEATGenome* const* genomes, int n, int* species)
+{
+	if (n == 0)
+		return;
+
+	// Compare against the old species in parallel
+	int threads = (mThreads < n)? mThreads : n;
+	if (mSpecies == 0)
+		for (int i=0; i<n; i++)
+			species[i] = -1;
+	else if (threads == 1)
+		classify (genomes, species, 0, n);
+	else {
+		pthread_t* ids = new pthread_t [threads];
+		Work* work = new Work [threads];
+		int started = 0;
+		for (int t=0; t<threads; t++) {
+			work[t].self    = this;
+			work[t].genomes = genomes;
+			work[t].species = species;
+			work[t].begin   = n*t/threads;
+			work[t].end     = n*(t+1)/threads;
+		}
+		for (; started<threads; started++)
+			if (pthread_create (&ids[started], NULL, classifyThread, &work[started]) != 0)
+				break;
+
+		// The slices whose threads could not be started are done here
+		for (int t=started; t<threads; t++)
+			classify (genomes, species, work[t].begin, work[t].end);
+		for (int t=0; t<started; t++)
+			pthread_join (ids[t], NULL);
+		delete [] ids;
+		delete [] work;
+	}
+
+	// Found new species for the genomes that didn't fit in any old one
+	int oldSpecies = mSpecies;
+	for (int i=0; i<n; i++)
+		if (species[i] == -1) {
+			species[i] = findSpecies (*genomes[i], oldSpecies);
+			if (species[i] == -1) {
+				addSpecies (*genomes[i]);
+				species[i] = mSpecies-1;
+			}
+		}
+
+	// Count the members
+	for (int s=0; s<mSpecies; s++)
+		mpReps[s].members = 0;
+	for (int i=0; i<n; i++)
+		mpReps[species[i]].members++;
+
+	// Drop the empty species and renumber the rest
+	int* renumber = new int [mSpecies];
+	int kept = 0;
+	for (int s=0; s<mSpecies; s++)
+		if (mpReps[s].members > 0) {
+			renumber[s] = kept;
+			if (s != kept) {
+				// Swap, so that the buffers of the dropped species are reused
+				Representative tmp = mpReps[kept];
+				mpReps[kept] = mpReps[s];
+				mpReps[s] = tmp;
+			}
+			kept++;
+		} else
+			renumber[s] = -1;
+	for (int i=0; i<n; i++)
+		species[i] = renumber[species[i]];
+	delete [] renumber;
+	mSpecies = kept;
+
+	// Pick a random member of each species as the new representative
+	for (int s=0; s<mSpecies; s++) {
+		int k = streamRnd (mpReps[s].members);
+		for (int i=0; i<n; i++)
+			if (species[i] == s && k-- == 0) {
+				setRepresentative (s, *genomes[i]);
+				break;
+			}
+	}
+}
+
+void* NEATSpeciation::classifyThread (void* arg)
+{
+	Work* work = static_cast<Work*> (arg);
+	work->self->classify (work->genomes, work->species, work->begin, work->end);
+	return NULL;
+}
+
+/*******************************************************************************
+ * Finds the species of the genomes in the given range among the
+ * species of the previous generation. Genomes that fit in none of
+ * them get species -1.
+ *
+ * Only reads the shared state, so it can be run in several threads.
+ ******************************************************************************/
+void NEATSpeciation::classify (const NEATGenome* const* genomes, int* species,
+							   int begin, int end) const
+{
+	for (int i=begin; i<end; i++)
+		species[i] = findSpecies (*genomes[i], 0);
+}
+
+/*******************************************************************************
+ * Finds the first species, starting from the given species index,
+ * whose representative is compatible with the genome.
+ *
+ * @return Species index or -1.
+ ******************************************************************************/
+int NEATSpeciation::findSpecies (const NEATGenome& genome, int from) const
+{
+	for (int s=from; s<mSpecies; s++) {
+		const Representative& rep = mpReps[s];
+		double d = NEATGenome::distance (genome.innovations(), genome.weights(), genome.size(),
+										 rep.innovations, rep.weights, rep.size,
+										 mC1, mC2, mC3);
+		if (d < mThreshold)
+			return s;
+	}
+	return -1;
+}
+
+/*******************************************************************************
+ * Caches the gene list of the genome as the representative of the
+ * given species.
+ ******************************************************************************/
+void NEATSpeciation::setRepresentative (int s, const NEATGenome& genome)
+{
+	Representative& rep = mpReps[s];
+	if (genome.size() > rep.size || rep.innovations == NULL) {
+		delete [] rep.innovations;
+		delete [] rep.weights;
+		rep.innovations = new int [genome.size()+1];
+		rep.weights = new double [genome.size()+1];
+	}
+	rep.size = genome.size();
+	memcpy (rep.innovations, genome.innovations(), rep.size*sizeof(int));
+	memcpy (rep.weights, genome.weights(), rep.size*sizeof(double));
+}
+
+void NEATSpeciation::addSpecies (const NEATGenome& genome)
+{
+	if (mSpecies == mCapacity) {
+		int capacity = (mCapacity>0)? mCapacity*2 : 16;
+		Representative* reps = new Representative [capacity];
+		for (int s=0; s<capacity; s++)
+			if (s < mCapacity)
+				reps[s] = mpReps[s];
+			else {
+				reps[s].size = 0;
+				reps[s].innovations = NULL;
+				reps[s].weights = NULL;
+				reps[s].members = 0;
+			}
+		delete [] mpReps;
+		mpReps = reps;
+		mCapacity = capacity;
+	}
+	// The size is reset so that the buffers are reallocated if needed
+	mpReps[mSpecies].size = 0;
+	setRepresentative (mSpecies, genome);
+	mpReps[mSpecies].members = 0;
+	mSpecies++;
+}
+
+void NEATSpeciation::check () const
+{
+	ASSERT (mSpecies>=0 && mSpecies<=mCapacity);
+	ASSERT (mThreshold>0);
+	ASSERT (mThreads>0);
+}
@@ -9,6 +9,7 @@
 
 #include "annalee/nolfi.h"
 #include "annalee/nolfinet.h"
+#include "annalee/randomstream.h"
 
 impl_dynamic (NolfiEncoding, {ANNEncoding});
 
@@ -89,13 +90,18 @@ bool NolfiEncoding::execute (const GeneticMsg& msg) const {
 	
 	// Add the plan to the host
 	if (net) {
-		net->setInitializer (new GaussianInitializer ());
+		net->setInitializer (new StreamInitializer ());
 
 		// Take pictures only if this is a picture-taking recreation
 		bool takePics = dynamic_cast<const TakeBrainPicsMsg*>(&msg) != NULL;
 
 		if (takePics) {
-			msg.mrHost.set ("brainpic1", new String (nnet.drawEPS()));
+			// The cell space picture may be large, so it is streamed
+			const TakeBrainPicsMsg& picMsg = static_cast<const TakeBrainPicsMsg&> (msg);
+			if (picMsg.mPath.length () > 0)
+				streamBrainPic (nnet, picMsg.mPath, "-pic1.eps");
+			else
+				msg.mrHost.set ("brainpic1", new String (nnet.drawEPS()));
 			msg.mrHost.set ("brainpic2", new String (net->drawEPS()));
 		}
 		net->cleanup (true, mPrunePassthroughs);
@@ -22,6 +22,7 @@
  *                                                                         *
  ***************************************************************************/
 
+#include <new>
 #include <magic/mgdev-eps.h>
 #include <magic/mlsystem.h>
 #include <magic/mturtle.h>
@@ -32,6 +33,8 @@
 
 #include "annalee/nolfi.h"
 #include "annalee/nolfinet.h"
+#include "annalee/epsstream.h"
+#include "annalee/arena.h"
 
 
 
@@ -47,30 +50,39 @@
 //////////////////////////////////////////////////////////////////////////////
 
 // This turtle device calculates the axon tip positions for neurons in
-// the Nolfi encoding
+// the Nolfi encoding. The tips are stored in the arena of the thread,
+// so the caller must have an ArenaFrame open.
 class NolfiTurtle : public TurtleDevice {
-	Array<Coord2D>	mTips;
+	Coord2D*		mpTips;
 	int				mTipPos;
+	int				mCapacity;
   public:
 
 			NolfiTurtle	(int tipEstimate=64) {
-				mTips.make (tipEstimate);
+				ASSERTWITH (Arena::current().inFrame(),
+							"NolfiTurtle used outside an ArenaFrame");
+				mpTips = Arena::current().allocate<Coord2D> (tipEstimate);
 				mTipPos=0;
+				mCapacity=tipEstimate;
 			}
 
 	virtual void	forwardLine	(const Coord2D& s, const Coord2D& e) {}
 
 	void	tip			(const Coord2D& tp) {
-		if (mTipPos>=mTips.size())
-			ASSERT (false);
-		// mTips.resize (int(mTips.size*1.5));
-		mTips[mTipPos++] = tp;
+		if (mTipPos>=mCapacity) {
+			// The old array is left in the arena
+			Coord2D* grown = Arena::current().allocate<Coord2D> (mCapacity*2);
+			for (int i=0; i<mTipPos; i++)
+				new (&grown[i]) Coord2D (mpTips[i]);
+			mpTips = grown;
+			mCapacity *= 2;
+		}
+		new (&mpTips[mTipPos++]) Coord2D (tp);
 	}
 
-	void	getTips		(Array<Coord2D>& tips) const {
-		tips.make (mTipPos);
-		for (int i=0; i<tips.size(); i++)
-			tips[i] = mTips[i];
+	int		getTips		(const Coord2D*& tips) const {
+		tips = mpTips;
+		return mTipPos;
 	}
 
 };
@@ -262,26 +274,31 @@ OStream& NolfiCell::operator>> (OStream& out) const
 }
 
 /*******************************************************************************
- * Grows an "axon tree" L-System from the cell.
+ * Grows an "axon tree" L-System from the cell. The caller must have an
+ * ArenaFrame open; the tips are released with it.
  ******************************************************************************/
-void NolfiCell::developAxon (
-	Array<Coord2D>& result, //< An array where the coordinates of the axon tips are stored.
+int NolfiCell::developAxon (
+	const Coord2D*& result, //< Set to the coordinates of the axon tips, in the arena of the thread.
 	double          scale   //< parameter tells usually the size of the neural space.
 	) const
 {
+	ASSERTWITH (Arena::current().inFrame(), "Axon developed outside an ArenaFrame");
+
 	if (true) {
 		NolfiTurtle turtleDevice;
 		Turtle turtle (turtleDevice, scale*mSegmentLength, mSegmentAngle*180/M_PI);
 		turtle.jumpTo (mCoord+Coord2D(0.5,0));
 		turtle.drawLSystem (smAxonString);
-		turtleDevice.getTips (result);
+		return turtleDevice.getTips (result);
 	} else {
-		result.make (11);
+		Coord2D* tips = Arena::current().allocate<Coord2D> (11);
 		for (int d=0; d<=10; d++) {
 			double angle = mSegmentAngle*(d-5)*M_PI/10.0;
-			result[d].x = mCoord.x+scale*fabs(mSegmentLength)*cos(angle);
-			result[d].y = mCoord.y+scale*fabs(mSegmentLength)*sin(angle);
+			new (&tips[d]) Coord2D (mCoord.x+scale*fabs(mSegmentLength)*cos(angle),
+									mCoord.y+scale*fabs(mSegmentLength)*sin(angle));
 		}
+		result = tips;
+		return 11;
 	}
 }
 
@@ -298,6 +315,19 @@ void NolfiCell::drawEPS (EPSDevice& devcon, double scale) const {
 	}
 }
 
+void NolfiCell::drawEPS (EPSStream& devcon, double scale) const {
+	// Cell body
+	devcon.circle (mCoord, 0.5, mExpression);
+	
+	// Axon tree
+	if (mExpression) {
+		EPSStreamTurtle turtleDevice (devcon, mTipRadius);
+		Turtle turtle (turtleDevice, scale*mSegmentLength, mSegmentAngle*180/M_PI);
+		turtle.jumpTo (mCoord+Coord2D(0.5,0));
+		turtle.drawLSystem (smAxonString);
+	}
+}
+
 void NolfiCell::check () const {
 	ASSERTWITH (mTipRadius>=0.5, "Internal error");
 }
@@ -557,15 +587,17 @@ int NolfiNet::connect (ANNetwork& network) const
 							 network.size()-mOutputs+(cells[i].mTypeID % mOutputs));
 		}
 		
-		// Generate branch tip points
-		Array<Coord2D> tips;
-		cells[i].developAxon (tips, mAxonScale); //mXSize
+		// Generate branch tip points. They are released with the frame
+		// at the end of each cell.
+		ArenaFrame frame;
+		const Coord2D* tips;
+		int tipCount = cells[i].developAxon (tips, mAxonScale); //mXSize
 
 		// Now find other cells that lie near these points
 		for (int j=0; j<cells.size()-mOutputs; j++)
 			if (cells[j].mFinalID > cells[i].mFinalID && cells[j].mFinalType!=CT_INPUT
 				&& !(cells[i].mFinalType==CT_OUTPUT && cells[j].mFinalType==CT_OUTPUT))
-				for (int k=0; k<tips.size(); k++) {
+				for (int k=0; k<tipCount; k++) {
 					double d = sqrt(cells[j].mCoord.sqdist (tips[k]));
 					if (d < cells[i].mTipRadius) {
 						// TRACE4 ("%d->%d: d(%d)=%f", i, j, k, d);
@@ -615,6 +647,28 @@ String NolfiNet::drawEPS () const
 	return epsdevice.getBuffer ();
 }
 
+void NolfiNet::drawEPS (int fd) const
+{
+	Coord2D picSize (175, 175);
+	EPSStream epsdevice (fd, picSize);				// Graphics device
+	epsdevice.framedStyle (mYSize, mYSize);			// Clipping with frame
+	
+	// Draw input/output region borders
+	epsdevice.lineWidth (0);
+	epsdevice.lineStyle ("dashed", mYSize/picSize.y);
+	epsdevice.line (Coord2D(mYSize*mInputBorder, 0),
+					Coord2D(mYSize*mInputBorder, mYSize));
+	epsdevice.line (Coord2D(mYSize*mOutputBorder, 0),
+					Coord2D(mYSize*mOutputBorder, mYSize));
+	epsdevice.lineStyle ("solid");
+
+	// Draw cells
+	for (int i=0; i<cells.size(); i++)
+		cells[i].drawEPS (epsdevice, mAxonScale);
+
+	epsdevice.printFooter ();
+}
+
 /*
 CString NolfiNet::drawLatex () const {
 	CString result;
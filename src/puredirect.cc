@@ -28,6 +28,7 @@
 #include <inanna/initializer.h>
 #include "annalee/anngenes.h"
 #include "annalee/miller.h"
+#include "annalee/randomstream.h"
 
 impl_dynamic (MillerEncoding, {ANNEncoding});
 
@@ -111,7 +112,7 @@ void MillerEncoding::init () {
 	// Find random p_c (connection probability) for the genome
 	double pc=0.5;
 	do {
-		pc = mPcAverage+gaussrnd(mPcVariance);
+		pc = mPcAverage+streamGaussrnd(mPcVariance);
 	} while (pc<0.0 || pc>1.0); // Not before it's in a range of a probability value
 
 	// Change the pc of all binary genes we own
@@ -196,7 +197,7 @@ bool MillerEncoding::execute (const GeneticMsg& msg) const {
 	}
 	
 	if (net) {
-		net->setInitializer (new GaussianInitializer (0.5));
+		net->setInitializer (new StreamInitializer (0.5));
 
 		// Take some nice photos
 		net->cleanup ();
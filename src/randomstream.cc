@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#include <math.h>
+#include <pthread.h>
+#include <magic/mclass.h>
+#include <inanna/annetwork.h>
+#include <annalee/randomstream.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//----                  |                  ___                              //
+//|   )  ___   _        |                 (   \ |        ___   ___          //
+//|---'  ___| |/ \   ---|  __  |/\/\       \__  -+- |/\ /   )  ___| |/\/\   //
+//|  \  (   | |   | (   | /  \ |  |  |        ) |   |   |---  (   | |  |  | //
+//|   \  \__| |   |  ---| \__/ |  |  |    \___)  \  |    \__   \__| |  |  | //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+RandomStream::RandomStream (const RandomKey& key)
+		: mKeyFields (key), mCounter (0)
+{
+	// Fold the fields into one 64-bit key, hashing after each so that
+	// nearby keys give unrelated streams
+	mKey = mix ((unsigned long long) key.seed);
+	mKey = mix (mKey ^ (unsigned int) key.generation);
+	mKey = mix (mKey ^ ((unsigned long long) (unsigned int) key.individual << 16));
+	mKey = mix (mKey ^ ((unsigned long long) (unsigned int) key.purpose << 48));
+}
+
+/** The SplitMix64 finalizer. */
+unsigned long long RandomStream::mix (unsigned long long z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/*******************************************************************************
+ * Box-Muller transform. The second value of the pair is not kept, so
+ * that each number depends only on the counter.
+ ******************************************************************************/
+double RandomStream::gaussian (double scale)
+{
+	double u1 = 1.0 - uniform (); // (0,1], for the logarithm
+	double u2 = uniform ();
+	return sqrt (-2.0 * log (u1)) * cos (2.0 * M_PI * u2) * scale;
+}
+
+/*******************************************************************************
+ * The stream of each thread is kept in thread-specific data.
+ ******************************************************************************/
+static pthread_key_t	sContextKey;
+static pthread_once_t	sContextOnce = PTHREAD_ONCE_INIT;
+
+static void createContextKey ()
+{
+	pthread_key_create (&sContextKey, NULL);
+}
+
+RandomContext::RandomContext (const RandomKey& key)
+		: mStream (key)
+{
+	pthread_once (&sContextOnce, createContextKey);
+	mpPrevious = static_cast<RandomStream*> (pthread_getspecific (sContextKey));
+	pthread_setspecific (sContextKey, (key.purpose != RandomStream::NONE)? &mStream : NULL);
+}
+
+RandomContext::~RandomContext ()
+{
+	pthread_setspecific (sContextKey, mpPrevious);
+}
+
+RandomStream* RandomContext::current ()
+{
+	pthread_once (&sContextOnce, createContextKey);
+	return static_cast<RandomStream*> (pthread_getspecific (sContextKey));
+}
+
+double streamFrnd ()
+{
+	RandomStream* stream = RandomContext::current ();
+	return stream? stream->uniform () : frnd ();
+}
+
+int streamRnd (int n)
+{
+	RandomStream* stream = RandomContext::current ();
+	return stream? stream->integer (n) : rnd (n);
+}
+
+double streamGaussrnd (double scale)
+{
+	RandomStream* stream = RandomContext::current ();
+	return stream? stream->gaussian (scale) : gaussrnd (scale);
+}
+
+/*******************************************************************************
+ * Implementation for @ref NetInitializer.
+ ******************************************************************************/
+void StreamInitializer::initialize (ANNetwork& net) const
+{
+	for (int i=0; i<net.size (); i++) {
+		Neuron& neuron = net[i];
+		neuron.setBias (streamGaussrnd (mScale));
+		for (int k=0; k<neuron.incomings (); k++)
+			neuron.incoming (k).setWeight (streamGaussrnd (mScale));
+	}
+}
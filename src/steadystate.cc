@@ -0,0 +1,371 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#include <pthread.h>
+#include <unistd.h>
+#include <magic/mclass.h>
+#include <magic/mtextstream.h>
+#include <nhp/individual.h>
+#include <annalee/learningenv.h>
+#include <annalee/neat.h>
+#include <annalee/randomstream.h>
+#include <annalee/arena.h>
+#include <annalee/steadystate.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//       ___                      |           ___                           //
+//      (   \ |    ___   ___      |          (   \ |    ___  |    ___       //
+//       \__  -+- /   )  ___|  ---| |   |     \__  -+-  ___| -+- /   )      //
+//          ) |   |---  (   | (   | |   |        ) |   (   | |   |---       //
+//      \___)  \   \__   \__|  ---|  \__|    \___)  \   \__|  \   \__       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+SteadyStateEA::SteadyStateEA (LearningEAEnv& env, const StringMap& params)
+		: mrEnv (env), mMembers (0), mDispatched (0), mEvaluated (0), mBest (-1),
+		  mpLog (NULL), mpOut (NULL), mpReported (NULL), mReportedReplaced (false)
+{
+	mSize           = getOrDefault (params, "SteadyStateEA.size", String(50)).toInt ();
+	mMaxEvaluations = getOrDefault (params, "SteadyStateEA.maxEvaluations", String(mSize*100)).toInt ();
+	mThreads        = getOrDefault (params, "SteadyStateEA.threads", String(0)).toInt ();
+	mTournament     = getOrDefault (params, "SteadyStateEA.tournament", String(3)).toInt ();
+	mCrossover      = getOrDefault (params, "SteadyStateEA.crossover", String(0.5)).toDouble ();
+	mMutationRate   = getOrDefault (params, "SteadyStateEA.mutationRate", String(0.1)).toDouble ();
+
+	if (mSize < 2)
+		throw generic_exception (format ("SteadyStateEA: population size %d is too small", mSize));
+	if (mTournament < 1)
+		mTournament = 1;
+
+	// One evaluator for each worker process keeps them all busy
+	if (mThreads <= 0)
+		mThreads = mrEnv.workers ();
+	if (mThreads <= 0)
+		mThreads = int (sysconf (_SC_NPROCESSORS_ONLN));
+	if (mThreads <= 0)
+		mThreads = 1;
+
+	mpMembers = new Member [mSize];
+	pthread_mutex_init (&mMutex, NULL);
+	pthread_mutex_init (&mReportMutex, NULL);
+
+	if (mrEnv.restored ())
+		restore (*mrEnv.restored ());
+	mrEnv.setCheckpointSource (this);
+}
+
+SteadyStateEA::~SteadyStateEA ()
+{
+	mrEnv.setCheckpointSource (NULL);
+	for (int i=0; i<mMembers; i++)
+		delete mpMembers[i].individual;
+	if (mReportedReplaced)
+		delete mpReported;
+	delete [] mpMembers;
+	pthread_mutex_destroy (&mMutex);
+	pthread_mutex_destroy (&mReportMutex);
+}
+
+double SteadyStateEA::bestFitness () const
+{
+	return (mBest >= 0)? mpMembers[mBest].fitness : 0.0;
+}
+
+/*******************************************************************************
+ * Runs the evaluator threads until the evaluation budget is spent.
+ *
+ * If an evaluation fails, no more offspring are dispatched and the
+ * first error is thrown after the evaluations in progress have
+ * finished.
+ ******************************************************************************/
+void SteadyStateEA::evolve (OStream& log, OStream& out)
+{
+	mpLog = &log;
+	mpOut = &out;
+	mError = "";
+
+	pthread_t* threads = new pthread_t [mThreads];
+	int started = 0;
+	for (; started<mThreads; started++)
+		if (pthread_create (&threads[started], NULL, evaluatorThread, this) != 0)
+			break;
+
+	// Evaluate in this thread if no threads could be started
+	if (started == 0)
+		evaluator ();
+
+	for (int t=0; t<started; t++)
+		pthread_join (threads[t], NULL);
+	delete [] threads;
+
+	// Leave the final champion to the environment
+	if (mBest >= 0) {
+		mrEnv.setChampion (mpMembers[mBest].individual);
+		if (mReportedReplaced)
+			delete mpReported;
+		mpReported = mpMembers[mBest].individual;
+		mReportedReplaced = false;
+	}
+
+	if (!mError.isEmpty ())
+		throw generic_exception (mError);
+}
+
+void* SteadyStateEA::evaluatorThread (void* self)
+{
+	static_cast<SteadyStateEA*> (self)->evaluator ();
+	return NULL;
+}
+
+/*******************************************************************************
+ * Breeds, evaluates and inserts offspring one at a time, until the
+ * evaluation budget is spent.
+ ******************************************************************************/
+void SteadyStateEA::evaluator ()
+{
+	while (true) {
+		pthread_mutex_lock (&mMutex);
+		if (mDispatched >= mMaxEvaluations || !mError.isEmpty ()) {
+			pthread_mutex_unlock (&mMutex);
+			break;
+		}
+		mDispatched++;
+
+		// Each offspring draws its random numbers from its own streams
+		RandomKey key;
+		key.seed       = mrEnv.seed ();
+		key.generation = mrEnv.generation ();
+		key.individual = mDispatched;
+
+		// The initial population is random, the rest are offspring
+		Individual* ind = NULL;
+		bool random = mDispatched <= mSize || mMembers < 2;
+		if (!random) {
+			key.purpose = RandomStream::SELECTION;
+			RandomContext context (key);
+			ind = breed ();
+		}
+		pthread_mutex_unlock (&mMutex);
+
+		try {
+			if (random) {
+				key.purpose = RandomStream::INITIALIZATION;
+				RandomContext context (key);
+				ind = new Individual ();
+				mrEnv.addFeaturesTo (*ind);
+				ind->init ();
+			} else {
+				// Mutation and decoding are done in parallel; the
+				// innovation registry of NEAT is thread-safe
+				key.purpose = RandomStream::VARIATION;
+				RandomContext variation (key);
+				ind->pointMutate (MutationRate (mMutationRate));
+
+				key.purpose = RandomStream::DECODING;
+				RandomContext decoding (key);
+				ind->getGene ("brainplan")->execute (GeneticMsg ("brainplan", *ind));
+			}
+
+			key.purpose = RandomStream::TRAINING;
+			double fitness;
+			{
+				RandomContext context (key);
+				fitness = mrEnv.evaluateg (*ind);
+			}
+
+			// The population owns the individual from here on
+			Individual* evaluated = ind;
+			ind = NULL;
+			pthread_mutex_lock (&mMutex);
+			bool due = insert (evaluated, fitness);
+			pthread_mutex_unlock (&mMutex);
+			if (due)
+				report ();
+		} catch (generic_exception& e) {
+			delete ind;
+			pthread_mutex_lock (&mMutex);
+			if (mError.isEmpty ())
+				mError = e.what ();
+			pthread_mutex_unlock (&mMutex);
+		}
+
+		// Recycle the temporary memory of the decoding
+		Arena::current ().reset ();
+	}
+}
+
+/*******************************************************************************
+ * Produces an unevaluated offspring from tournament-selected parents.
+ * Called with the population locked, so the parents are copied
+ * before the lock is released.
+ ******************************************************************************/
+Individual* SteadyStateEA::breed ()
+{
+	int first = tournament ();
+	Individual* child = static_cast<Individual*> (mpMembers[first].individual->replicate ());
+
+	if (streamFrnd() < mCrossover) {
+		int second = tournament ();
+		const NEATEncoding* other = dynamic_cast<const NEATEncoding*> (mpMembers[second].individual->getGene ("brainplan"));
+		NEATEncoding* plan = dynamic_cast<NEATEncoding*> (const_cast<Genstruct*> (child->getGene ("brainplan")));
+		if (second != first && plan && other) {
+			if (mpMembers[second].fitness < mpMembers[first].fitness)
+				plan->crossover (*other, *dynamic_cast<const NEATEncoding*> (mpMembers[first].individual->getGene ("brainplan")));
+			else
+				plan->crossover (*dynamic_cast<const NEATEncoding*> (mpMembers[first].individual->getGene ("brainplan")), *other);
+		}
+	}
+
+	return child;
+}
+
+/** Returns the index of the best of randomly chosen members. */
+int SteadyStateEA::tournament () const
+{
+	int winner = streamRnd (mMembers);
+	for (int i=1; i<mTournament; i++) {
+		int candidate = streamRnd (mMembers);
+		if (mpMembers[candidate].fitness < mpMembers[winner].fitness)
+			winner = candidate;
+	}
+	return winner;
+}
+
+/*******************************************************************************
+ * Inserts an evaluated individual in the population, replacing the
+ * worst member if the population is full. An individual worse than
+ * all the members is dropped. Called with the population locked.
+ *
+ * @return True if the champion should be reported, which is done
+ * after every population-size insertions.
+ ******************************************************************************/
+bool SteadyStateEA::insert (Individual* ind, double fitness)
+{
+	mEvaluated++;
+
+	int slot = mMembers;
+	if (mMembers == mSize) {
+		slot = 0;
+		for (int i=1; i<mMembers; i++)
+			if (mpMembers[i].fitness > mpMembers[slot].fitness)
+				slot = i;
+		if (fitness >= mpMembers[slot].fitness) {
+			delete ind;
+			ind = NULL;
+		} else if (mpMembers[slot].individual == mpReported)
+			mReportedReplaced = true; // Deleted when the next champion is set
+		else
+			delete mpMembers[slot].individual;
+	} else
+		mMembers++;
+
+	if (ind) {
+		mpMembers[slot].individual = ind;
+		mpMembers[slot].fitness    = fitness;
+		if (mBest < 0 || fitness < mpMembers[mBest].fitness)
+			mBest = slot;
+	}
+
+	return mEvaluated % mSize == 0;
+}
+
+/*******************************************************************************
+ * Reports the current champion through the environment. Only the
+ * choice of the champion is done with the population locked.
+ *
+ * The environment refers to the champion until it is given the next
+ * one, so a champion that is replaced in the population is not
+ * deleted before that, and the previous champion is deleted only
+ * after the environment has let go of it.
+ ******************************************************************************/
+void SteadyStateEA::report ()
+{
+	pthread_mutex_lock (&mReportMutex);
+	pthread_mutex_lock (&mMutex);
+	Individual* previous = mReportedReplaced? mpReported : NULL;
+	mpReported = mpMembers[mBest].individual;
+	mReportedReplaced = false;
+	pthread_mutex_unlock (&mMutex);
+
+	mrEnv.setChampion (mpReported);
+	delete previous;
+
+	try {
+		mrEnv.cycle_report (*mpLog, *mpOut);
+	} catch (...) {
+		pthread_mutex_unlock (&mReportMutex);
+		throw;
+	}
+	pthread_mutex_unlock (&mReportMutex);
+}
+
+/** Counters of the evolution in a checkpoint. */
+struct SteadyStateState {
+	int				evaluated;
+};
+
+void SteadyStateEA::addCheckpointSections (CheckpointWriter& writer)
+{
+	pthread_mutex_lock (&mMutex);
+	Individual** individuals = new Individual* [mMembers];
+	double* fitness = new double [mMembers];
+	for (int i=0; i<mMembers; i++) {
+		individuals[i] = mpMembers[i].individual;
+		fitness[i]     = mpMembers[i].fitness;
+	}
+	mrEnv.addGenomes (writer, "pop", individuals, fitness, mMembers);
+	delete [] individuals;
+	delete [] fitness;
+
+	SteadyStateState* state = (SteadyStateState*) writer.reserve ("ssea", sizeof(SteadyStateState));
+	state->evaluated = mEvaluated;
+	pthread_mutex_unlock (&mMutex);
+}
+
+/*******************************************************************************
+ * Continues from the population of a checkpoint. The offspring that
+ * were in evaluation when the checkpoint was written are bred again.
+ ******************************************************************************/
+void SteadyStateEA::restore (const Checkpoint& checkpoint)
+{
+	long size;
+	const SteadyStateState* state = (const SteadyStateState*) checkpoint.section ("ssea", &size);
+	if (!state || size != sizeof(SteadyStateState))
+		return;
+
+	Individual** individuals = new Individual* [mSize];
+	double* fitness = new double [mSize];
+	mMembers = mrEnv.restoreGenomes (checkpoint, "pop", individuals, fitness, mSize);
+	for (int i=0; i<mMembers; i++) {
+		mpMembers[i].individual = individuals[i];
+		mpMembers[i].fitness    = fitness[i];
+		if (mBest < 0 || fitness[i] < mpMembers[mBest].fitness)
+			mBest = i;
+	}
+	delete [] individuals;
+	delete [] fitness;
+
+	if (mMembers > 0)
+		mEvaluated = mDispatched = state->evaluated;
+}
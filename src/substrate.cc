@@ -0,0 +1,467 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include <magic/mclass.h>
+#include <inanna/annetwork.h>
+#include <nhp/individual.h>
+#include <annalee/substrate.h>
+#include <annalee/neatnetwork.h>
+
+impl_dynamic (SubstrateEncoding, {NEATEncoding});
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//            ___  ----  ----  |   | ----                  |                //
+//           /   \ |   ) |   ) |\  | |   )  ___  |         |                //
+//           |     |---  |---  | \ | |---<  ___| -+-  ___  |/ \             //
+//           |     |     |     |  \| |   ) (   | |   /     |   |            //
+//           \___/ |     |     |   | |___)  \__|  \  \___  |   |            //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/** Batched evaluator for a feed-forward CPPN genome.
+ *
+ * The values are stored unit-major: each unit has a row of values,
+ * one for each query in the batch. A unit is evaluated by adding the
+ * weighted rows of its sources into its own row and applying the
+ * activation function to the whole row, so the inner loops are
+ * simple loops over contiguous memory that the compiler can
+ * vectorize.
+ *
+ * The activation function of a hidden node is selected by its node
+ * identifier. As the same structural innovation gives the same node
+ * identifier, matching nodes share their function across genomes.
+ **/
+class CPPNBatch {
+  public:
+	enum functions {BIPOLAR=0, GAUSSIAN=1, SINE=2, LINEAR=3, FUNCTIONS=4};
+
+					CPPNBatch		(const NEATGenome& genome, int inputs, int capacity);
+					~CPPNBatch		();
+
+	/** Evaluates the CPPN for a batch of n queries, each with the
+	 *  coordinates of its source and target neuron.
+	 *
+	 * @return Row of n outputs, valid until the next evaluation.
+	 **/
+	const double*	evaluate		(const double* x1, const double* y1,
+									 const double* x2, const double* y2, int n);
+
+  private:
+	int		mInputs;
+	int		mUnits;
+	int		mCapacity;	// Maximum batch size, the stride of the rows
+	int*	mpStart;	// First incoming connection of each unit
+	int*	mpSource;	// Source unit of each connection
+	double*	mpWeight;	// Weight of each connection
+	int*	mpFunction;	// Activation function of each unit
+	double*	mpValues;	// mUnits rows of mCapacity values
+
+					CPPNBatch		(const CPPNBatch& other) {FORBIDDEN}
+};
+
+CPPNBatch::CPPNBatch (const NEATGenome& genome, int inputs, int capacity)
+		: mInputs (inputs),
+		  mUnits (inputs + genome.nodes() + 1),
+		  mCapacity (capacity)
+{
+	int* order = new int [genome.nodes()+1];
+	bool acyclic = NEATNetwork::activationOrder (genome, inputs, order);
+	ASSERTWITH (acyclic, "Cycle in a CPPN genome");
+
+	mpStart = new int [mUnits+1];
+	for (int u=0; u<=mUnits; u++)
+		mpStart[u] = 0;
+	for (int i=0; i<genome.size(); i++)
+		if (genome.enabled (i))
+			mpStart[NEATNetwork::unitIndex (genome, inputs, 1, order, genome.target (i))+1]++;
+	for (int u=0; u<mUnits; u++)
+		mpStart[u+1] += mpStart[u];
+
+	mpSource = new int [mpStart[mUnits]+1];
+	mpWeight = new double [mpStart[mUnits]+1];
+	int* fill = new int [mUnits];
+	memcpy (fill, mpStart, mUnits*sizeof(int));
+	for (int i=0; i<genome.size(); i++)
+		if (genome.enabled (i)) {
+			int t = NEATNetwork::unitIndex (genome, inputs, 1, order, genome.target (i));
+			int k = fill[t]++;
+			mpSource[k] = NEATNetwork::unitIndex (genome, inputs, 1, order, genome.source (i));
+			mpWeight[k] = genome.weight (i);
+		}
+	delete [] fill;
+
+	mpFunction = new int [mUnits];
+	for (int u=0; u<mUnits; u++)
+		mpFunction[u] = LINEAR;
+	for (int h=0; h<genome.nodes(); h++)
+		mpFunction[order[h]] = genome.node (h) % FUNCTIONS;
+	mpFunction[mUnits-1] = BIPOLAR;
+	delete [] order;
+
+	mpValues = new double [mUnits*mCapacity];
+}
+
+CPPNBatch::~CPPNBatch ()
+{
+	delete [] mpStart;
+	delete [] mpSource;
+	delete [] mpWeight;
+	delete [] mpFunction;
+	delete [] mpValues;
+}
+
+const double* CPPNBatch::evaluate (const double* x1, const double* y1,
+								   const double* x2, const double* y2, int n)
+{
+	ASSERT (n <= mCapacity);
+
+	// The input rows
+	memcpy (mpValues, x1, n*sizeof(double));
+	memcpy (mpValues+mCapacity, y1, n*sizeof(double));
+	memcpy (mpValues+2*mCapacity, x2, n*sizeof(double));
+	memcpy (mpValues+3*mCapacity, y2, n*sizeof(double));
+	double* bias = mpValues + 4*mCapacity;
+	for (int b=0; b<n; b++)
+		bias[b] = 1.0;
+
+	for (int u=mInputs; u<mUnits; u++) {
+		double* row = mpValues + u*mCapacity;
+		for (int b=0; b<n; b++)
+			row[b] = 0.0;
+		for (int k=mpStart[u]; k<mpStart[u+1]; k++) {
+			const double* src = mpValues + mpSource[k]*mCapacity;
+			const double w = mpWeight[k];
+			for (int b=0; b<n; b++)
+				row[b] += w*src[b];
+		}
+
+		switch (mpFunction[u]) {
+		  case BIPOLAR:
+			  for (int b=0; b<n; b++)
+				  row[b] = 2.0/(1.0+exp(-4.9*row[b])) - 1.0;
+			  break;
+		  case GAUSSIAN:
+			  for (int b=0; b<n; b++)
+				  row[b] = exp(-row[b]*row[b]);
+			  break;
+		  case SINE:
+			  for (int b=0; b<n; b++)
+				  row[b] = sin(row[b]);
+			  break;
+		  default:
+			  break;
+		}
+	}
+
+	return mpValues + (mUnits-1)*mCapacity;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//              ___        |                                                //
+//             (   \       |           |        ___  |    ___               //
+//              \__  |   | |---   ___  -+- |/\  ___| -+- /   )              //
+//                 ) |   | |   ) (     |   |   (   | |   |---               //
+//             \___)  \__! |__/   ---)  \  |    \__|  \   \__               //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+/*******************************************************************************
+ * Constructor.
+ *
+ * @param params["SubstrateEncoding.columns"] Number of hidden
+ * columns in the substrate. [Default=1]
+ *
+ * @param params["SubstrateEncoding.rows"] Number of hidden neurons
+ * in each column. [Default=ANNEncoding.maxHidden/columns]
+ *
+ * @param params["SubstrateEncoding.threshold"] Minimum magnitude of
+ * the CPPN output for expressing a connection. [Default=0.2]
+ *
+ * @param params["SubstrateEncoding.maxWeight"] Weight of a
+ * connection for a CPPN output of magnitude 1. [Default=3.0]
+ *
+ * @param params["SubstrateEncoding.topology"] "layered" to connect
+ * only the adjacent columns, "full" to connect every neuron to every
+ * other non-input neuron. The full substrate is relaxed for
+ * NEATEncoding.relaxation steps. [Default="layered"]
+ *
+ * The CPPN genome is evolved with the NEAT operators, so the
+ * parameters of @ref NEATEncoding apply too, except that recurrent
+ * connections are never allowed.
+ ******************************************************************************/
+SubstrateEncoding::SubstrateEncoding (const GeneticID& name, const StringMap& params)
+		: NEATEncoding (name, params)
+{
+	mSubInputs  = mInputs;
+	mSubOutputs = mOutputs;
+	mColumns    = getOrDefault (params, "SubstrateEncoding.columns", String(1)).toInt ();
+	mRows       = getOrDefault (params, "SubstrateEncoding.rows",
+								String((mColumns>0)? mMaxHidden/mColumns : 0)).toInt ();
+	mThreshold  = getOrDefault (params, "SubstrateEncoding.threshold", String(0.2)).toDouble ();
+	mMaxWeight  = getOrDefault (params, "SubstrateEncoding.maxWeight", String(3.0)).toDouble ();
+	mFullTopology = getOrDefault (params, "SubstrateEncoding.topology", String("layered")) == "full";
+	mRecurrent  = false;
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+SubstrateEncoding::SubstrateEncoding (const SubstrateEncoding& other)
+		: NEATEncoding (other),
+		  mSubInputs (other.mSubInputs),
+		  mSubOutputs (other.mSubOutputs),
+		  mColumns (other.mColumns),
+		  mRows (other.mRows),
+		  mThreshold (other.mThreshold),
+		  mMaxWeight (other.mMaxWeight),
+		  mFullTopology (other.mFullTopology)
+{
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+Genstruct* SubstrateEncoding::replicate () const
+{
+	return new SubstrateEncoding (*this);
+}
+
+/*******************************************************************************
+ *
+ ******************************************************************************/
+void SubstrateEncoding::copy (const Genstruct& o)
+{
+	NEATEncoding::copy (o);
+	const SubstrateEncoding& other = static_cast<const SubstrateEncoding&>(o);
+	mSubInputs  = other.mSubInputs;
+	mSubOutputs = other.mSubOutputs;
+	mColumns    = other.mColumns;
+	mRows       = other.mRows;
+	mThreshold  = other.mThreshold;
+	mMaxWeight  = other.mMaxWeight;
+	mFullTopology = other.mFullTopology;
+}
+
+/*******************************************************************************
+ * Creates the CPPN genome. The inputs and outputs given by the
+ * environment are those of the substrate; the NEAT genome has the
+ * inputs and the single output of the CPPN.
+ ******************************************************************************/
+void SubstrateEncoding::addPrivateGenes (Gentainer& g, const StringMap& params)
+{
+	mInputs  = CPPN_INPUTS;
+	mOutputs = 1;
+	NEATEncoding::addPrivateGenes (g, params);
+}
+
+/*******************************************************************************
+ * Decodes the substrate network.
+ *
+ * The substrate units are ordered as inputs, hidden columns from left
+ * to right, outputs. The candidate sources of each target unit are a
+ * contiguous range of units, or, in the full topology, all the other
+ * units. The coordinates are scaled to [-1,1] for the CPPN.
+ *
+ * The queries for all the candidate connections are made in a single
+ * pass. They are packed into batches that span several targets, so
+ * the batches stay full even if the targets have few sources, and
+ * the memory used does not grow with the number of pairs.
+ ******************************************************************************/
+NEATNetwork* SubstrateEncoding::decode () const
+{
+	int hiddens = mColumns*mRows;
+	int columns = (hiddens>0)? mColumns : 0;
+	int units = mSubInputs + hiddens + mSubOutputs;
+
+	// Place the units in the cell space. The hidden columns are
+	// between the input and output borders of NolfiNet.
+	double* x = new double [units];
+	double* y = new double [units];
+	int u = 0;
+	for (int i=0; i<mSubInputs; i++, u++) {
+		x[u] = -1.0;
+		y[u] = (mSubInputs>1)? 2.0*i/(mSubInputs-1)-1.0 : 0.0;
+	}
+	for (int c=0; c<mColumns; c++)
+		for (int r=0; r<mRows; r++, u++) {
+			x[u] = 2.0*(0.3 + 0.45*(c+0.5)/mColumns) - 1.0;
+			y[u] = (mRows>1)? 2.0*r/(mRows-1)-1.0 : 0.0;
+		}
+	for (int o=0; o<mSubOutputs; o++, u++) {
+		x[u] = 1.0;
+		y[u] = (mSubOutputs>1)? 2.0*o/(mSubOutputs-1)-1.0 : 0.0;
+	}
+
+	// The candidate sources of each target
+	int* first = new int [units];
+	int* last  = new int [units];
+	long pairs = 0;
+	for (int t=mSubInputs; t<units; t++) {
+		if (mFullTopology) {
+			first[t] = 0;
+			last[t]  = units;
+		} else {
+			// The previous column, or the inputs
+			int column = (t < mSubInputs+hiddens)? (t-mSubInputs)/mRows : columns;
+			first[t] = (column == 0)? 0 : mSubInputs + (column-1)*mRows;
+			last[t]  = (column == 0)? mSubInputs : mSubInputs + column*mRows;
+		}
+		pairs += last[t]-first[t];
+		if (first[t] <= t && t < last[t])
+			pairs--;		// No self-connections
+	}
+
+	const int batch = (pairs < 16384)? ((pairs > 0)? int (pairs) : 1) : 16384;
+	CPPNBatch cppn (mGenome, CPPN_INPUTS, batch);
+	double* qx1 = new double [4*batch];
+	double* qy1 = qx1 + batch;
+	double* qx2 = qy1 + batch;
+	double* qy2 = qx2 + batch;
+	int* qSource = new int [2*batch];
+	int* qTarget = qSource + batch;
+
+	// The connections are written directly in compressed-row form
+	int* start = new int [units+1];
+	int capacity = 1024;
+	int* source = new int [capacity];
+	double* weight = new double [capacity];
+	int conns = 0;
+	int nextStart = 0;		// First unit whose start is not set yet
+	int queued = 0;
+	long made = 0;
+	for (int t=mSubInputs; t<units; t++)
+		for (int s=first[t]; s<last[t]; s++) {
+			if (s == t)
+				continue;
+			qx1[queued] = x[s];
+			qy1[queued] = y[s];
+			qx2[queued] = x[t];
+			qy2[queued] = y[t];
+			qSource[queued] = s;
+			qTarget[queued] = t;
+			queued++;
+			made++;
+			if (queued < batch && made < pairs)
+				continue;
+
+			// Express the connections of a full batch
+			const double* out = cppn.evaluate (qx1, qy1, qx2, qy2, queued);
+			if (conns+queued > capacity) {
+				while (conns+queued > capacity)
+					capacity *= 2;
+				int* newSource = new int [capacity];
+				double* newWeight = new double [capacity];
+				memcpy (newSource, source, conns*sizeof(int));
+				memcpy (newWeight, weight, conns*sizeof(double));
+				delete [] source;
+				delete [] weight;
+				source = newSource;
+				weight = newWeight;
+			}
+			for (int q=0; q<queued; q++) {
+				for (; nextStart<=qTarget[q]; nextStart++)
+					start[nextStart] = conns;
+				double w = out[q];
+				if (fabs(w) > mThreshold) {
+					source[conns] = qSource[q];
+					weight[conns] = ((w>0)? w-mThreshold : w+mThreshold)/(1.0-mThreshold)*mMaxWeight;
+					conns++;
+				}
+			}
+			queued = 0;
+		}
+	for (; nextStart<=units; nextStart++)
+		start[nextStart] = conns;
+
+	delete [] qx1;
+	delete [] qSource;
+	delete [] first;
+	delete [] last;
+	delete [] x;
+	delete [] y;
+
+	return new NEATNetwork (mSubInputs, hiddens, mSubOutputs, start, source, weight,
+							mFullTopology? mRelaxation : 1);
+}
+
+/*******************************************************************************
+ * Builds the substrate network.
+ *
+ * The compiled substrate is placed in the host as "neatbrain", which
+ * is what is evaluated and reported. Like for a recurrent NEAT
+ * genome, the "brainplan" is an @ref ANNetwork with the forward
+ * connections of the substrate.
+ ******************************************************************************/
+bool SubstrateEncoding::execute (const GeneticMsg& msg) const
+{
+	NEATNetwork* substrate = decode ();
+
+	ANNetwork* net = new ANNetwork (format ("%d-%d-%d", mSubInputs, mColumns*mRows,
+											mSubOutputs));
+	substrate->connect (*net);
+
+	// Take pictures only if this is a picture-taking recreation
+	if (!dynamic_cast<const TakeBrainPicsMsg*>(&msg)) {
+		// Place the brain description into host
+		net->cleanup (true, mPrunePassthroughs);
+		msg.mrHost.set ("brainplan", net);
+		msg.mrHost.set ("neatbrain", substrate);
+		return true;
+	}
+
+	String desc = format ("substrate: %d units, %d connections\n",
+						  substrate->units(), substrate->connections());
+	for (int i=0; i<mGenome.size(); i++)
+		desc += format ("%d: %d -> %d, w=%+f%s\n", mGenome.innovation (i),
+						mGenome.source (i), mGenome.target (i), mGenome.weight (i),
+						mGenome.enabled (i)? "" : " (disabled)");
+	msg.mrHost.set ("brainpic1", new String (net->drawEPS()));
+	net->cleanup (true, mPrunePassthroughs);
+	msg.mrHost.set ("brainpic2", new String (net->drawEPS()));
+	net->drawFeedForward();
+	msg.mrHost.set ("brainpic3", new String (net->drawEPS()));
+	msg.mrHost.set ("braindesc1", new String (desc));
+	delete net; // The net was created only for taking babypics
+	delete substrate;
+
+	return true;
+}
+
+/*******************************************************************************
+ * Implementation for @ref Object.
+ ******************************************************************************/
+void SubstrateEncoding::check () const
+{
+	NEATEncoding::check ();
+	ASSERT (mInputs == CPPN_INPUTS && mOutputs == 1);
+	ASSERT (mSubInputs>0 && mSubOutputs>0);
+	ASSERT (mColumns>=0 && mRows>=0);
+	ASSERT (mColumns*mRows == 0 || (mColumns>0 && mRows>0));
+	ASSERT (mThreshold>=0 && mThreshold<1);
+	ASSERT (mMaxWeight>0);
+}
@@ -0,0 +1,236 @@
+/***************************************************************************
+ *   This file is part of the Annalee library.                             *
+ *                                                                         *
+ *   Copyright (C) 1998-2008 Marko Grnroos <magi@iki.fi>                  *
+ *                                                                         *
+ ***************************************************************************
+ *                                                                         *
+ *  This library is free software; you can redistribute it and/or          *
+ *  modify it under the terms of the GNU Library General Public            *
+ *  License as published by the Free Software Foundation; either           *
+ *  version 2 of the License, or (at your option) any later version.       *
+ *                                                                         *
+ *  This library is distributed in the hope that it will be useful,        *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of         *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU      *
+ *  Library General Public License for more details.                       *
+ *                                                                         *
+ *  You should have received a copy of the GNU Library General Public      *
+ *  License along with this library; see the file COPYING.LIB.  If         *
+ *  not, write to the Free Software Foundation, Inc., 59 Temple Place      *
+ *  - Suite 330, Boston, MA 02111-1307, USA.                               *
+ *                                                                         *
+ ***************************************************************************/
+#include <stdlib.h>
+#include <unistd.h>
+#include <magic/mclass.h>
+#include <annalee/workstealer.h>
+
+//////////////////////////////////////////////////////////////////////////////
+//                                                                          //
+//      |   |          |        ___                  | o                    //
+//      |   |          |       (   \ |    ___   ___  |     _                //
+//      | | |  __  |/\ | /      \__  -+- /   )  ___| | |  |/ \   ___        //
+//      |\ /| /  \ |   |<          ) |   |---  (   | | |  |   | (   \       //
+//      |   | \__/ |   | \     \___)  \   \__   \__| | |  |   |  ---/       //
+//                                                                          //
+//////////////////////////////////////////////////////////////////////////////
+
+WorkStealer::WorkStealer (int threads)
+		: mThreads (threads), mpDeques (NULL), mDeques (0), mpTasks (NULL), mSteals (0), mFailed (false)
+{
+	if (mThreads <= 0)
+		mThreads = int (sysconf (_SC_NPROCESSORS_ONLN));
+	if (mThreads <= 0)
+		mThreads = 1;
+	pthread_mutex_init (&mMutex, NULL);
+}
+
+WorkStealer::~WorkStealer ()
+{
+	pthread_mutex_destroy (&mMutex);
+}
+
+/** A task with its estimated cost, for sorting. */
+struct CostedTask {
+	double	cost;
+	int		task;
+};
+
+static int compareCost (const void* a, const void* b)
+{
+	const CostedTask& x = *static_cast<const CostedTask*> (a);
+	const CostedTask& y = *static_cast<const CostedTask*> (b);
+	if (x.cost != y.cost)
+		return (x.cost > y.cost)? -1 : 1;
+	return x.task - y.task;
+}
+
+/*******************************************************************************
+ * Runs the tasks in the threads; see the class description.
+ ******************************************************************************/
+void WorkStealer::run (WorkTasks& tasks, int n)
+{
+	if (n <= 0)
+		return;
+
+	// Sort the tasks largest first
+	CostedTask* sorted = new CostedTask [n];
+	for (int i=0; i<n; i++) {
+		sorted[i].cost = tasks.cost (i);
+		sorted[i].task = i;
+	}
+	qsort (sorted, n, sizeof (CostedTask), compareCost);
+
+	// Deal them to the threads that have the least work so far
+	int threads = (mThreads < n)? mThreads : n;
+	mDeques  = threads;
+	mpDeques = new Deque [threads];
+	for (int t=0; t<threads; t++) {
+		mpDeques[t].tasks     = new int [n];
+		mpDeques[t].costs     = new double [n];
+		mpDeques[t].head      = 0;
+		mpDeques[t].tail      = 0;
+		mpDeques[t].remaining = 0.0;
+		pthread_mutex_init (&mpDeques[t].mutex, NULL);
+	}
+	for (int i=0; i<n; i++) {
+		int least = 0;
+		for (int t=1; t<threads; t++)
+			if (mpDeques[t].remaining < mpDeques[least].remaining)
+				least = t;
+		Deque& deque = mpDeques[least];
+		deque.tasks[deque.tail] = sorted[i].task;
+		deque.costs[deque.tail] = sorted[i].cost;
+		deque.tail++;
+		deque.remaining += sorted[i].cost;
+	}
+	delete [] sorted;
+
+	mpTasks  = &tasks;
+	mSteals  = 0;
+	mFailed  = false;
+	mError   = "";
+
+	// This thread works as thread 0
+	pthread_t* ids  = new pthread_t [threads];
+	Work*      args = new Work [threads];
+	int started = 1;
+	for (; started<threads; started++) {
+		args[started].self   = this;
+		args[started].thread = started;
+		if (pthread_create (&ids[started], NULL, workerThread, &args[started]) != 0)
+			break;
+	}
+	// The tasks of the threads that could not be started are stolen
+	work (0);
+	for (int t=1; t<started; t++)
+		pthread_join (ids[t], NULL);
+	delete [] ids;
+	delete [] args;
+
+	for (int t=0; t<threads; t++) {
+		delete [] mpDeques[t].tasks;
+		delete [] mpDeques[t].costs;
+		pthread_mutex_destroy (&mpDeques[t].mutex);
+	}
+	delete [] mpDeques;
+	mpDeques = NULL;
+	mDeques  = 0;
+	mpTasks = NULL;
+
+	if (mFailed)
+		throw generic_exception (mError);
+}
+
+void* WorkStealer::workerThread (void* work)
+{
+	Work* w = static_cast<Work*> (work);
+	w->self->work (w->thread);
+	return NULL;
+}
+
+/*******************************************************************************
+ * Runs the own tasks of a thread, and then stolen tasks until there
+ * is nothing left.
+ ******************************************************************************/
+void WorkStealer::work (int thread)
+{
+	int task;
+	while (pop (thread, task) || steal (task)) {
+		pthread_mutex_lock (&mMutex);
+		bool failed = mFailed;
+		pthread_mutex_unlock (&mMutex);
+		if (failed)
+			continue; // Skip the rest after an error
+		try {
+			mpTasks->run (task);
+		} catch (generic_exception& e) {
+			fail (e.what ());
+		}
+	}
+}
+
+/** Takes the largest task from the deque of a thread. */
+bool WorkStealer::pop (int thread, int& task)
+{
+	Deque& deque = mpDeques[thread];
+	bool found = false;
+	pthread_mutex_lock (&deque.mutex);
+	if (deque.head < deque.tail) {
+		task = deque.tasks[deque.head];
+		deque.remaining -= deque.costs[deque.head];
+		deque.head++;
+		found = true;
+	}
+	pthread_mutex_unlock (&deque.mutex);
+	return found;
+}
+
+/** Takes the smallest task from the deque with the most remaining cost. */
+bool WorkStealer::steal (int& task)
+{
+	while (true) {
+		int victim = -1;
+		double most = -1.0;
+		for (int t=0; t<mDeques; t++) {
+			pthread_mutex_lock (&mpDeques[t].mutex);
+			if (mpDeques[t].head < mpDeques[t].tail && mpDeques[t].remaining > most) {
+				most   = mpDeques[t].remaining;
+				victim = t;
+			}
+			pthread_mutex_unlock (&mpDeques[t].mutex);
+		}
+		if (victim < 0)
+			return false;
+
+		// The victim may have been emptied meanwhile
+		Deque& deque = mpDeques[victim];
+		bool found = false;
+		pthread_mutex_lock (&deque.mutex);
+		if (deque.head < deque.tail) {
+			deque.tail--;
+			task = deque.tasks[deque.tail];
+			deque.remaining -= deque.costs[deque.tail];
+			found = true;
+		}
+		pthread_mutex_unlock (&deque.mutex);
+
+		if (found) {
+			pthread_mutex_lock (&mMutex);
+			mSteals++;
+			pthread_mutex_unlock (&mMutex);
+			return true;
+		}
+	}
+}
+
+void WorkStealer::fail (const String& error)
+{
+	pthread_mutex_lock (&mMutex);
+	if (!mFailed) {
+		mFailed = true;
+		mError  = error;
+	}
+	pthread_mutex_unlock (&mMutex);
+}